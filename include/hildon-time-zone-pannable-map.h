@@ -28,6 +28,13 @@ hildon_pannable_map_zoom_in(HildonPannableMap *map);
 void
 hildon_pannable_map_zoom_out(HildonPannableMap *map);
 
+void
+hildon_pannable_map_set_scale(HildonPannableMap *map, float scale, gint x,
+                              gint y);
+
+float
+hildon_pannable_map_get_scale(HildonPannableMap *map);
+
 void
 hildon_pannable_map_set_city(HildonPannableMap *map, const Cityinfo *city);
 
@@ -37,8 +44,34 @@ hildon_pannable_map_get_city(HildonPannableMap *map);
 void
 hildon_pannable_map_stop(HildonPannableMap *map);
 
+void
+hildon_pannable_map_set_show_cities(HildonPannableMap *map, gboolean show);
+
+void
+hildon_pannable_map_set_highlight_zone(HildonPannableMap *map,
+                                       gboolean highlight);
+
+void
+hildon_pannable_map_set_show_daylight(HildonPannableMap *map, gboolean show);
+
+void
+hildon_pannable_map_set_daylight_time(HildonPannableMap *map, time_t time);
+
+void
+hildon_pannable_map_update_daylight(HildonPannableMap *map);
+
 void
 hildon_pannable_map_free(HildonPannableMap *map);
 
 void
 hildon_pannable_map_clear_cache(void);
+
+void
+hildon_pannable_map_set_cache_budget(gsize bytes);
+
+gsize
+hildon_pannable_map_get_cache_size(void);
+
+void
+hildon_pannable_map_get_paint_stats(HildonPannableMap *map, guint *exposes,
+                                    guint64 *pixels, guint *last_pixels);
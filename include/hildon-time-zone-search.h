@@ -18,3 +18,6 @@ hildon_time_zone_search_get_city(HildonTimeZoneSearch *tz_search);
 
 void
 hildon_time_zone_search_free(HildonTimeZoneSearch *tz_search);
+
+void
+hildon_time_zone_search_clear_cache(void);
@@ -11,6 +11,7 @@
 #include "hildon-time-zone-chooser.h"
 #include "hildon-time-zone-pannable-map.h"
 #include "hildon-time-zone-search.h"
+#include "hildon-time-zone-utc-offset.h"
 
 #include "config.h"
 
@@ -71,33 +72,8 @@ _map_update_cb(const Cityinfo *city, gpointer user_data)
   if (city && chooser &&
       chooser->response != FEEDBACK_DIALOG_RESPONSE_CITY_CHOSEN)
   {
-    gchar *tz;
+    gchar *tz = hildon_time_zone_utc_offset_format_label(city, NULL);
     gchar *markup;
-    int utc_offset = time_get_utc_offset(cityinfo_get_zone(city));
-    int utc_offset_hours = utc_offset / -3600;
-    gchar *city_name = cityinfo_get_name(city);
-    gchar *country = cityinfo_get_country(city);
-
-    if (utc_offset % 3600)
-    {
-      int utc_offset_minutes = (utc_offset % 3600) / 60;
-      const char *fmt;
-
-      utc_offset_hours = utc_offset / -3600;
-
-      if (utc_offset_minutes < 0)
-          utc_offset_minutes = -utc_offset_minutes;
-
-      fmt = _("osso-clock", "cloc_fi_timezonefull_minutes");
-      tz = g_strdup_printf(fmt, utc_offset_hours, utc_offset_minutes,
-                           city_name, country);
-    }
-    else
-    {
-      const char *fmt = _("osso-clock", "cloc_fi_timezonefull");
-
-      tz = g_strdup_printf(fmt, utc_offset_hours, city_name, country);
-    }
 
     markup = g_strdup_printf("<span>%s</span>", tz);
     gtk_label_set_markup(GTK_LABEL(chooser->label), markup);
@@ -279,6 +255,7 @@ run_timeout_cb(gpointer user_data)
     chooser->run_timer_id =
         gdk_threads_add_timeout(1000 * (60 - local_time.tm_sec) + 500,
                                 run_timeout_cb, chooser);
+    hildon_pannable_map_update_daylight(chooser->map);
     city = hildon_pannable_map_get_city(chooser->map);
 
     if (city)
@@ -314,6 +291,8 @@ hildon_time_zone_chooser_run(HildonTimeZoneChooser *chooser)
   gtk_main();
 
   hildon_pannable_map_clear_cache();
+  hildon_time_zone_search_clear_cache();
+  hildon_time_zone_utc_offset_clear_cache();
 
   return chooser->response;
 }
@@ -0,0 +1,247 @@
+#include <math.h>
+
+#include "hildon-time-zone-city-index.h"
+
+#define CITY_INDEX_MAX_CELLS 256
+#define CITY_INDEX_HYSTERESIS 0.002
+
+typedef struct
+{
+  float x;
+  float y;
+  const Cityinfo *city;
+} CityIndexEntry;
+
+/* Uniform grid over the normalized map. Entries are sorted by cell, the
+ * entries of cell i are entries[cell_start[i]] to entries[cell_start[i + 1]]
+ * exclusive. */
+struct _HildonTimeZoneCityIndex
+{
+  gint ref_count;
+  Cityinfo **cities;
+  CityIndexEntry *entries;
+  guint *cell_start;
+  gint cols;
+  gint rows;
+};
+
+static HildonTimeZoneCityIndex *shared_index = NULL;
+
+static float
+_wrap(float v)
+{
+  v -= floorf(v);
+
+  /* floorf() rounding can leave exactly 1.0 for tiny negative values */
+  return v < 1.0 ? v : 0.0;
+}
+
+static gint
+_cell_of(HildonTimeZoneCityIndex *index, float x, float y)
+{
+  gint col = MIN((gint)(x * index->cols), index->cols - 1);
+  gint row = MIN((gint)(y * index->rows), index->rows - 1);
+
+  return row * index->cols + col;
+}
+
+static HildonTimeZoneCityIndex *
+_city_index_new(void)
+{
+  HildonTimeZoneCityIndex *index = g_new0(HildonTimeZoneCityIndex, 1);
+  guint n_cells;
+  guint *fill;
+  guint n = 0;
+  guint i;
+
+  index->cities = cityinfo_get_all();
+
+  while (index->cities && index->cities[n])
+    n++;
+
+  /* about two cities per cell */
+  index->cols = CLAMP((gint)ceil(sqrt(n / 2.0)), 1, CITY_INDEX_MAX_CELLS);
+  index->rows = index->cols;
+  n_cells = index->cols * index->rows;
+
+  index->entries = g_new(CityIndexEntry, MAX(n, 1));
+  index->cell_start = g_new0(guint, n_cells + 1);
+  fill = g_new0(guint, n_cells);
+
+  for (i = 0; i < n; i++)
+  {
+    float x = _wrap(cityinfo_get_xpos(index->cities[i]));
+    float y = _wrap(cityinfo_get_ypos(index->cities[i]));
+
+    index->cell_start[_cell_of(index, x, y) + 1]++;
+  }
+
+  for (i = 0; i < n_cells; i++)
+    index->cell_start[i + 1] += index->cell_start[i];
+
+  for (i = 0; i < n; i++)
+  {
+    float x = _wrap(cityinfo_get_xpos(index->cities[i]));
+    float y = _wrap(cityinfo_get_ypos(index->cities[i]));
+    gint cell = _cell_of(index, x, y);
+    CityIndexEntry *entry =
+        &index->entries[index->cell_start[cell] + fill[cell]++];
+
+    entry->x = x;
+    entry->y = y;
+    entry->city = index->cities[i];
+  }
+
+  g_free(fill);
+
+  return index;
+}
+
+HildonTimeZoneCityIndex *
+hildon_time_zone_city_index_ref()
+{
+  if (!shared_index)
+    shared_index = _city_index_new();
+
+  shared_index->ref_count++;
+
+  return shared_index;
+}
+
+void
+hildon_time_zone_city_index_unref(HildonTimeZoneCityIndex *index)
+{
+  if (!index || --index->ref_count)
+    return;
+
+  if (index == shared_index)
+    shared_index = NULL;
+
+  cityinfo_free_all(index->cities);
+  g_free(index->entries);
+  g_free(index->cell_start);
+  g_free(index);
+}
+
+Cityinfo **
+hildon_time_zone_city_index_get_cities(HildonTimeZoneCityIndex *index)
+{
+  g_return_val_if_fail(index != NULL, NULL);
+
+  return index->cities;
+}
+
+static float
+_wrapped_delta(float a, float b)
+{
+  float d = fabsf(a - b);
+
+  return d > 0.5 ? 1.0 - d : d;
+}
+
+static void
+_scan_cell(HildonTimeZoneCityIndex *index, gint col, gint row, float x,
+           float y, const CityIndexEntry **best, float *best_d2)
+{
+  gint cell;
+  guint i;
+
+  col %= index->cols;
+  row %= index->rows;
+
+  if (col < 0)
+    col += index->cols;
+
+  if (row < 0)
+    row += index->rows;
+
+  cell = row * index->cols + col;
+
+  for (i = index->cell_start[cell]; i < index->cell_start[cell + 1]; i++)
+  {
+    const CityIndexEntry *entry = &index->entries[i];
+    float dx = _wrapped_delta(entry->x, x);
+    float dy = _wrapped_delta(entry->y, y);
+    float d2 = dx * dx + dy * dy;
+
+    if (d2 < *best_d2)
+    {
+      *best_d2 = d2;
+      *best = entry;
+    }
+  }
+}
+
+const Cityinfo *
+hildon_time_zone_city_index_find_nearest(HildonTimeZoneCityIndex *index,
+                                         double x, double y,
+                                         const Cityinfo *current)
+{
+  const CityIndexEntry *best = NULL;
+  float best_d2 = G_MAXFLOAT;
+  float cell_size;
+  gint max_ring;
+  gint col;
+  gint row;
+  gint r;
+
+  g_return_val_if_fail(index != NULL, NULL);
+
+  x = _wrap(x);
+  y = _wrap(y);
+  col = MIN((gint)(x * index->cols), index->cols - 1);
+  row = MIN((gint)(y * index->rows), index->rows - 1);
+  cell_size = 1.0 / MAX(index->cols, index->rows);
+  max_ring = MAX(index->cols, index->rows) / 2 + 1;
+
+  /* Visit rings of cells around the query cell. Everything in ring r is at
+   * least r - 1 cells away, so stop once the best match is closer than that. */
+  for (r = 0; r <= max_ring; r++)
+  {
+    float reach = (r - 1) * cell_size;
+    gint i;
+
+    if (best && r > 1 && best_d2 <= reach * reach)
+      break;
+
+    if (!r)
+    {
+      _scan_cell(index, col, row, x, y, &best, &best_d2);
+      continue;
+    }
+
+    for (i = -r; i <= r; i++)
+    {
+      _scan_cell(index, col + i, row - r, x, y, &best, &best_d2);
+      _scan_cell(index, col + i, row + r, x, y, &best, &best_d2);
+    }
+
+    for (i = -r + 1; i < r; i++)
+    {
+      _scan_cell(index, col - r, row + i, x, y, &best, &best_d2);
+      _scan_cell(index, col + r, row + i, x, y, &best, &best_d2);
+    }
+  }
+
+  if (!best)
+    return NULL;
+
+  if (current)
+  {
+    float dx;
+    float dy;
+    float d;
+
+    if (cityinfo_get_id(best->city) == cityinfo_get_id(current))
+      return NULL;
+
+    dx = _wrapped_delta(_wrap(cityinfo_get_xpos(current)), x);
+    dy = _wrapped_delta(_wrap(cityinfo_get_ypos(current)), y);
+    d = sqrtf(best_d2) + CITY_INDEX_HYSTERESIS;
+
+    if (dx * dx + dy * dy <= d * d)
+      return NULL;
+  }
+
+  return best->city;
+}
@@ -0,0 +1,62 @@
+#ifndef HILDON_TIME_ZONE_CITY_INDEX_H
+#define HILDON_TIME_ZONE_CITY_INDEX_H
+
+#include <cityinfo.h>
+
+G_BEGIN_DECLS
+
+typedef struct _HildonTimeZoneCityIndex HildonTimeZoneCityIndex;
+
+/**
+ * @brief Returns the process-wide spatial index over all known cities,
+ *        building it on first use.
+ *
+ * @returns The shared index. Release with #hildon_time_zone_city_index_unref().
+ */
+HildonTimeZoneCityIndex *
+hildon_time_zone_city_index_ref(void);
+
+/**
+ * @brief Releases a reference obtained with
+ *        #hildon_time_zone_city_index_ref(). The index is freed together with
+ *        the last reference.
+ *
+ * @param index A #HildonTimeZoneCityIndex.
+ */
+void
+hildon_time_zone_city_index_unref(HildonTimeZoneCityIndex *index);
+
+/**
+ * @brief Returns all cities in the index.
+ *
+ * @param index A #HildonTimeZoneCityIndex.
+ *
+ * @returns A NULL terminated array owned by the index.
+ */
+Cityinfo **
+hildon_time_zone_city_index_get_cities(HildonTimeZoneCityIndex *index);
+
+/**
+ * @brief Finds the city nearest to a map position.
+ *
+ * Positions are normalized map coordinates in the [0, 1) range, distances
+ * wrap around the map edges. To avoid flickering between two cities at about
+ * the same distance, @current is kept unless another city is closer by a
+ * small margin.
+ *
+ * @param index A #HildonTimeZoneCityIndex.
+ * @param x Horizontal map position.
+ * @param y Vertical map position.
+ * @param current The currently selected city, or NULL.
+ *
+ * @returns The nearest city, owned by the index, or NULL if @current is still
+ *          the best match or there are no cities.
+ */
+const Cityinfo *
+hildon_time_zone_city_index_find_nearest(HildonTimeZoneCityIndex *index,
+                                         double x, double y,
+                                         const Cityinfo *current);
+
+G_END_DECLS
+
+#endif /* HILDON_TIME_ZONE_CITY_INDEX_H */
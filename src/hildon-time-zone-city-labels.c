@@ -0,0 +1,300 @@
+#include <math.h>
+
+#include "hildon-time-zone-city-labels.h"
+
+#define CITY_LABELS_CELL_SIZE 128
+#define CITY_LABELS_MARKER_SIZE 6
+#define CITY_LABELS_GAP 2
+
+/* A placed city, @marker and @label are relative to the marker center */
+typedef struct
+{
+  const Cityinfo *city;
+  gint x;
+  gint y;
+  GdkRectangle marker;
+  GdkRectangle label;
+} CityLabel;
+
+typedef void (*CityLabelVisitFunc)(const CityLabel *label, gint dx, gint dy,
+                                   gpointer user_data);
+
+/* Uniform grid over the map, each cell lists the labels whose marker center
+ * is in it. No marker or label reaches further than @extent from its
+ * center. */
+struct _HildonTimeZoneCityLabels
+{
+  gint width;
+  gint height;
+  gint cols;
+  gint rows;
+  gint extent;
+  GArray *labels;
+  GArray **cells;
+};
+
+typedef struct
+{
+  const GdkRectangle *rect;
+  gboolean free;
+} CityLabelsFreeCheck;
+
+typedef struct
+{
+  const GdkRectangle *area;
+  HildonTimeZoneCityLabelFunc func;
+  gpointer user_data;
+} CityLabelsVisit;
+
+static void
+_union_bounds(const CityLabel *label, GdkRectangle *bounds)
+{
+  gdk_rectangle_union(&label->marker, &label->label, bounds);
+}
+
+static gint
+_floor_div(gint a, gint b)
+{
+  return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+/* Visits the labels possibly intersecting @area, once for every copy of the
+ * map the area overlaps. @dx and @dy shift a label into the coordinates of
+ * the area. */
+static void
+_visit_near(HildonTimeZoneCityLabels *labels, const GdkRectangle *area,
+            CityLabelVisitFunc func, gpointer user_data)
+{
+  gint x1 = area->x - labels->extent;
+  gint y1 = area->y - labels->extent;
+  gint x2 = area->x + area->width + labels->extent;
+  gint y2 = area->y + area->height + labels->extent;
+  gint copy_x;
+  gint copy_y;
+
+  for (copy_y = _floor_div(y1, labels->height);
+       copy_y * labels->height < y2; copy_y++)
+  {
+    gint dy = copy_y * labels->height;
+    gint row1 = MAX(y1 - dy, 0) / CITY_LABELS_CELL_SIZE;
+    gint row2 = MIN(y2 - dy, labels->height - 1) / CITY_LABELS_CELL_SIZE;
+
+    for (copy_x = _floor_div(x1, labels->width);
+         copy_x * labels->width < x2; copy_x++)
+    {
+      gint dx = copy_x * labels->width;
+      gint col1 = MAX(x1 - dx, 0) / CITY_LABELS_CELL_SIZE;
+      gint col2 = MIN(x2 - dx, labels->width - 1) / CITY_LABELS_CELL_SIZE;
+      gint row;
+      gint col;
+
+      for (row = row1; row <= row2; row++)
+      {
+        for (col = col1; col <= col2; col++)
+        {
+          GArray *cell = labels->cells[row * labels->cols + col];
+          guint i;
+
+          for (i = 0; i < cell->len; i++)
+          {
+            func(&g_array_index(labels->labels, CityLabel,
+                                g_array_index(cell, guint, i)),
+                 dx, dy, user_data);
+          }
+        }
+      }
+    }
+  }
+}
+
+static gboolean
+_rect_overlaps(const GdkRectangle *rect, const GdkRectangle *other, gint x,
+               gint y)
+{
+  GdkRectangle shifted = *other;
+
+  shifted.x += x;
+  shifted.y += y;
+
+  return gdk_rectangle_intersect(rect, &shifted, NULL);
+}
+
+static void
+_check_free(const CityLabel *label, gint dx, gint dy, gpointer user_data)
+{
+  CityLabelsFreeCheck *check = user_data;
+
+  if (_rect_overlaps(check->rect, &label->marker, label->x + dx,
+                     label->y + dy) ||
+      _rect_overlaps(check->rect, &label->label, label->x + dx,
+                     label->y + dy))
+  {
+    check->free = FALSE;
+  }
+}
+
+/* Whether @rect, relative to @x, @y, overlaps nothing placed yet */
+static gboolean
+_is_free(HildonTimeZoneCityLabels *labels, const GdkRectangle *rect, gint x,
+         gint y)
+{
+  GdkRectangle area = *rect;
+  CityLabelsFreeCheck check;
+
+  area.x += x;
+  area.y += y;
+  check.rect = &area;
+  check.free = TRUE;
+  _visit_near(labels, &area, _check_free, &check);
+
+  return check.free;
+}
+
+static void
+_place_city(HildonTimeZoneCityLabels *labels, PangoLayout *layout,
+            const Cityinfo *city)
+{
+  float fx = cityinfo_get_xpos(city);
+  float fy = cityinfo_get_ypos(city);
+  GdkRectangle candidates[4];
+  CityLabel label;
+  GdkRectangle bounds;
+  gint half = CITY_LABELS_MARKER_SIZE / 2;
+  gint width;
+  gint height;
+  guint i;
+
+  label.city = city;
+  label.x = (gint)((fx - floorf(fx)) * labels->width) % labels->width;
+  label.y = (gint)((fy - floorf(fy)) * labels->height) % labels->height;
+  label.marker.x = -half;
+  label.marker.y = -half;
+  label.marker.width = CITY_LABELS_MARKER_SIZE;
+  label.marker.height = CITY_LABELS_MARKER_SIZE;
+
+  if (!_is_free(labels, &label.marker, label.x, label.y))
+    return;
+
+  pango_layout_set_text(layout, cityinfo_get_name(city), -1);
+  pango_layout_get_pixel_size(layout, &width, &height);
+
+  /* right, left, above and below the marker, in order of preference */
+  for (i = 0; i < G_N_ELEMENTS(candidates); i++)
+  {
+    candidates[i].width = width;
+    candidates[i].height = height;
+  }
+
+  candidates[0].x = half + CITY_LABELS_GAP;
+  candidates[0].y = -height / 2;
+  candidates[1].x = -half - CITY_LABELS_GAP - width;
+  candidates[1].y = -height / 2;
+  candidates[2].x = -width / 2;
+  candidates[2].y = -half - CITY_LABELS_GAP - height;
+  candidates[3].x = -width / 2;
+  candidates[3].y = half + CITY_LABELS_GAP;
+
+  for (i = 0; i < G_N_ELEMENTS(candidates); i++)
+  {
+    if (_is_free(labels, &candidates[i], label.x, label.y))
+      break;
+  }
+
+  if (i == G_N_ELEMENTS(candidates))
+    return;
+
+  label.label = candidates[i];
+  g_array_append_val(labels->labels, label);
+
+  i = labels->labels->len - 1;
+  g_array_append_val(
+        labels->cells[(label.y / CITY_LABELS_CELL_SIZE) * labels->cols +
+                      label.x / CITY_LABELS_CELL_SIZE], i);
+
+  _union_bounds(&label, &bounds);
+  labels->extent = MAX(labels->extent, -bounds.x);
+  labels->extent = MAX(labels->extent, -bounds.y);
+  labels->extent = MAX(labels->extent, bounds.x + bounds.width);
+  labels->extent = MAX(labels->extent, bounds.y + bounds.height);
+}
+
+HildonTimeZoneCityLabels *
+hildon_time_zone_city_labels_new(HildonTimeZoneCityIndex *index,
+                                 PangoLayout *layout, gint width, gint height)
+{
+  HildonTimeZoneCityLabels *labels;
+  Cityinfo **cities;
+  gint i;
+
+  g_return_val_if_fail(index != NULL, NULL);
+  g_return_val_if_fail(width > 0 && height > 0, NULL);
+
+  labels = g_new0(HildonTimeZoneCityLabels, 1);
+  labels->width = width;
+  labels->height = height;
+  labels->cols = (width + CITY_LABELS_CELL_SIZE - 1) / CITY_LABELS_CELL_SIZE;
+  labels->rows = (height + CITY_LABELS_CELL_SIZE - 1) / CITY_LABELS_CELL_SIZE;
+  labels->labels = g_array_new(FALSE, FALSE, sizeof(CityLabel));
+  labels->cells = g_new(GArray *, labels->cols * labels->rows);
+
+  for (i = 0; i < labels->cols * labels->rows; i++)
+    labels->cells[i] = g_array_new(FALSE, FALSE, sizeof(guint));
+
+  cities = hildon_time_zone_city_index_get_cities(index);
+
+  for (i = 0; cities && cities[i]; i++)
+    _place_city(labels, layout, cities[i]);
+
+  return labels;
+}
+
+void
+hildon_time_zone_city_labels_free(HildonTimeZoneCityLabels *labels)
+{
+  gint i;
+
+  if (!labels)
+    return;
+
+  for (i = 0; i < labels->cols * labels->rows; i++)
+    g_array_free(labels->cells[i], TRUE);
+
+  g_free(labels->cells);
+  g_array_free(labels->labels, TRUE);
+  g_free(labels);
+}
+
+static void
+_visit_label(const CityLabel *label, gint dx, gint dy, gpointer user_data)
+{
+  CityLabelsVisit *visit = user_data;
+  GdkRectangle bounds;
+  GdkRectangle text;
+
+  _union_bounds(label, &bounds);
+
+  if (!_rect_overlaps(visit->area, &bounds, label->x + dx, label->y + dy))
+    return;
+
+  text = label->label;
+  text.x += label->x + dx;
+  text.y += label->y + dy;
+  visit->func(label->city, label->x + dx, label->y + dy, &text,
+              visit->user_data);
+}
+
+void
+hildon_time_zone_city_labels_foreach(HildonTimeZoneCityLabels *labels,
+                                     const GdkRectangle *area,
+                                     HildonTimeZoneCityLabelFunc func,
+                                     gpointer user_data)
+{
+  CityLabelsVisit visit;
+
+  g_return_if_fail(labels != NULL);
+
+  visit.area = area;
+  visit.func = func;
+  visit.user_data = user_data;
+  _visit_near(labels, area, _visit_label, &visit);
+}
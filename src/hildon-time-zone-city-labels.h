@@ -0,0 +1,73 @@
+#ifndef HILDON_TIME_ZONE_CITY_LABELS_H
+#define HILDON_TIME_ZONE_CITY_LABELS_H
+
+#include <gdk/gdk.h>
+
+#include "hildon-time-zone-city-index.h"
+
+G_BEGIN_DECLS
+
+typedef struct _HildonTimeZoneCityLabels HildonTimeZoneCityLabels;
+
+/**
+ * @brief Called for each city shown in an area.
+ *
+ * @param city The city.
+ * @param x Horizontal position of the city marker, in the coordinates of the
+ *          area asked for.
+ * @param y Vertical position of the city marker.
+ * @param label Where the name of the city goes, in the same coordinates.
+ * @param user_data The data passed to
+ *                  #hildon_time_zone_city_labels_foreach().
+ */
+typedef void (*HildonTimeZoneCityLabelFunc)(const Cityinfo *city, gint x,
+                                            gint y, const GdkRectangle *label,
+                                            gpointer user_data);
+
+/**
+ * @brief Places the markers and name labels of the cities in a map of the
+ *        given size.
+ *
+ * Cities are placed greedily in the order of the index, each one only if its
+ * marker and one of the positions around the marker for its name do not
+ * overlap anything placed before. The layout wraps around the map edges.
+ *
+ * @param index The cities to place.
+ * @param layout A layout with the font of the labels, used to measure them.
+ * @param width Width of the map in pixels.
+ * @param height Height of the map in pixels.
+ *
+ * @returns The placed labels. Free with #hildon_time_zone_city_labels_free().
+ */
+HildonTimeZoneCityLabels *
+hildon_time_zone_city_labels_new(HildonTimeZoneCityIndex *index,
+                                 PangoLayout *layout, gint width,
+                                 gint height);
+
+/**
+ * @brief Frees labels created with #hildon_time_zone_city_labels_new().
+ *
+ * @param labels A #HildonTimeZoneCityLabels.
+ */
+void
+hildon_time_zone_city_labels_free(HildonTimeZoneCityLabels *labels);
+
+/**
+ * @brief Calls @func for every placed city whose marker or label intersects
+ *        @area, visiting only the part of the layout near it.
+ *
+ * @param labels A #HildonTimeZoneCityLabels.
+ * @param area The area in map pixels, it does not need to be wrapped to the
+ *             map size.
+ * @param func The function to call.
+ * @param user_data Data passed to @func.
+ */
+void
+hildon_time_zone_city_labels_foreach(HildonTimeZoneCityLabels *labels,
+                                     const GdkRectangle *area,
+                                     HildonTimeZoneCityLabelFunc func,
+                                     gpointer user_data);
+
+G_END_DECLS
+
+#endif /* HILDON_TIME_ZONE_CITY_LABELS_H */
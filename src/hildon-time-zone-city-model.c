@@ -0,0 +1,453 @@
+#include <glib/gstdio.h>
+#include <locale.h>
+#include <time.h>
+
+#include "hildon-time-zone-city-model.h"
+#include "hildon-time-zone-search-index.h"
+#include "hildon-time-zone-utc-offset.h"
+
+#define CITY_MODEL_ZONEINFO_DIR "/usr/share/zoneinfo"
+
+#ifndef CITY_MODEL_CITYINFO_DIR
+#define CITY_MODEL_CITYINFO_DIR "/usr/share/cityinfo"
+#endif
+
+/* A subset has @base and @rows, and reads everything else from @base */
+struct _HildonTimeZoneCityModel
+{
+  GObject parent;
+  Cityinfo **cities;
+  gint n_cities;
+  gint stamp;
+  gchar **labels;
+  gchar *locale;
+  guint64 zone_data_stamp;
+  time_t labels_checked;
+  time_t labels_expire;
+  HildonTimeZoneSearchIndex *search_index;
+  HildonTimeZoneCityModel *base;
+  guint32 *rows;
+};
+
+struct _HildonTimeZoneCityModelClass
+{
+  GObjectClass parent_class;
+};
+
+static HildonTimeZoneCityModel *shared_model = NULL;
+
+static void
+hildon_time_zone_city_model_tree_model_init(GtkTreeModelIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE(
+    HildonTimeZoneCityModel, hildon_time_zone_city_model, G_TYPE_OBJECT,
+    G_IMPLEMENT_INTERFACE(GTK_TYPE_TREE_MODEL,
+                          hildon_time_zone_city_model_tree_model_init))
+
+static gboolean
+_iter_is_valid(HildonTimeZoneCityModel *model, GtkTreeIter *iter)
+{
+  gint row = GPOINTER_TO_INT(iter->user_data);
+
+  return iter->stamp == model->stamp && row >= 0 && row < model->n_cities;
+}
+
+static gboolean
+_set_iter(HildonTimeZoneCityModel *model, GtkTreeIter *iter, gint row)
+{
+  if (row < 0 || row >= model->n_cities)
+  {
+    iter->stamp = 0;
+    return FALSE;
+  }
+
+  iter->stamp = model->stamp;
+  iter->user_data = GINT_TO_POINTER(row);
+
+  return TRUE;
+}
+
+static GtkTreeModelFlags
+_get_flags(GtkTreeModel *tree_model)
+{
+  return GTK_TREE_MODEL_LIST_ONLY | GTK_TREE_MODEL_ITERS_PERSIST;
+}
+
+static gint
+_get_n_columns(GtkTreeModel *tree_model)
+{
+  return HILDON_TIME_ZONE_CITY_MODEL_N_COLUMNS;
+}
+
+static GType
+_get_column_type(GtkTreeModel *tree_model, gint index)
+{
+  switch (index)
+  {
+    case HILDON_TIME_ZONE_CITY_MODEL_COLUMN_LABEL:
+      return G_TYPE_STRING;
+    case HILDON_TIME_ZONE_CITY_MODEL_COLUMN_CITY:
+      return G_TYPE_POINTER;
+    case HILDON_TIME_ZONE_CITY_MODEL_COLUMN_FLAGS:
+    case HILDON_TIME_ZONE_CITY_MODEL_COLUMN_NUMBER:
+      return G_TYPE_INT;
+  }
+
+  return G_TYPE_INVALID;
+}
+
+static gboolean
+_get_iter(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreePath *path)
+{
+  HildonTimeZoneCityModel *model = HILDON_TIME_ZONE_CITY_MODEL(tree_model);
+
+  if (gtk_tree_path_get_depth(path) != 1)
+    return FALSE;
+
+  return _set_iter(model, iter, gtk_tree_path_get_indices(path)[0]);
+}
+
+static GtkTreePath *
+_get_path(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  HildonTimeZoneCityModel *model = HILDON_TIME_ZONE_CITY_MODEL(tree_model);
+
+  g_return_val_if_fail(_iter_is_valid(model, iter), NULL);
+
+  return gtk_tree_path_new_from_indices(GPOINTER_TO_INT(iter->user_data), -1);
+}
+
+static void
+_get_value(GtkTreeModel *tree_model, GtkTreeIter *iter, gint column,
+           GValue *value)
+{
+  HildonTimeZoneCityModel *model = HILDON_TIME_ZONE_CITY_MODEL(tree_model);
+  gint row = GPOINTER_TO_INT(iter->user_data);
+
+  g_return_if_fail(_iter_is_valid(model, iter));
+
+  g_value_init(value, _get_column_type(tree_model, column));
+
+  switch (column)
+  {
+    case HILDON_TIME_ZONE_CITY_MODEL_COLUMN_LABEL:
+      g_value_set_string(value,
+                         hildon_time_zone_city_model_get_label(model, row));
+      break;
+    case HILDON_TIME_ZONE_CITY_MODEL_COLUMN_CITY:
+      g_value_set_pointer(
+            value, (gpointer)hildon_time_zone_city_model_get_city(model, row));
+      break;
+    case HILDON_TIME_ZONE_CITY_MODEL_COLUMN_FLAGS:
+      g_value_set_int(value, 4);
+      break;
+    case HILDON_TIME_ZONE_CITY_MODEL_COLUMN_NUMBER:
+      g_value_set_int(value, (model->rows ? model->rows[row] : row) + 1);
+      break;
+  }
+}
+
+static gboolean
+_iter_next(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  HildonTimeZoneCityModel *model = HILDON_TIME_ZONE_CITY_MODEL(tree_model);
+
+  return _set_iter(model, iter, GPOINTER_TO_INT(iter->user_data) + 1);
+}
+
+static gboolean
+_iter_children(GtkTreeModel *tree_model, GtkTreeIter *iter,
+               GtkTreeIter *parent)
+{
+  HildonTimeZoneCityModel *model = HILDON_TIME_ZONE_CITY_MODEL(tree_model);
+
+  if (parent)
+  {
+    iter->stamp = 0;
+    return FALSE;
+  }
+
+  return _set_iter(model, iter, 0);
+}
+
+static gboolean
+_iter_has_child(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  return FALSE;
+}
+
+static gint
+_iter_n_children(GtkTreeModel *tree_model, GtkTreeIter *iter)
+{
+  HildonTimeZoneCityModel *model = HILDON_TIME_ZONE_CITY_MODEL(tree_model);
+
+  return iter ? 0 : model->n_cities;
+}
+
+static gboolean
+_iter_nth_child(GtkTreeModel *tree_model, GtkTreeIter *iter,
+                GtkTreeIter *parent, gint n)
+{
+  HildonTimeZoneCityModel *model = HILDON_TIME_ZONE_CITY_MODEL(tree_model);
+
+  if (parent)
+  {
+    iter->stamp = 0;
+    return FALSE;
+  }
+
+  return _set_iter(model, iter, n);
+}
+
+static gboolean
+_iter_parent(GtkTreeModel *tree_model, GtkTreeIter *iter, GtkTreeIter *child)
+{
+  iter->stamp = 0;
+
+  return FALSE;
+}
+
+static void
+hildon_time_zone_city_model_tree_model_init(GtkTreeModelIface *iface)
+{
+  iface->get_flags = _get_flags;
+  iface->get_n_columns = _get_n_columns;
+  iface->get_column_type = _get_column_type;
+  iface->get_iter = _get_iter;
+  iface->get_path = _get_path;
+  iface->get_value = _get_value;
+  iface->iter_next = _iter_next;
+  iface->iter_children = _iter_children;
+  iface->iter_has_child = _iter_has_child;
+  iface->iter_n_children = _iter_n_children;
+  iface->iter_nth_child = _iter_nth_child;
+  iface->iter_parent = _iter_parent;
+}
+
+static void
+hildon_time_zone_city_model_finalize(GObject *object)
+{
+  HildonTimeZoneCityModel *model = HILDON_TIME_ZONE_CITY_MODEL(object);
+  gint i;
+
+  if (model->base)
+  {
+    g_object_unref(model->base);
+    g_free(model->rows);
+  }
+  else
+  {
+    for (i = 0; i < model->n_cities; i++)
+      g_free(model->labels[i]);
+
+    g_free(model->labels);
+    g_free(model->locale);
+    hildon_time_zone_search_index_free(model->search_index);
+    cityinfo_free_all(model->cities);
+  }
+
+  G_OBJECT_CLASS(hildon_time_zone_city_model_parent_class)->finalize(object);
+}
+
+static void
+hildon_time_zone_city_model_class_init(HildonTimeZoneCityModelClass *klass)
+{
+  G_OBJECT_CLASS(klass)->finalize = hildon_time_zone_city_model_finalize;
+}
+
+static void
+hildon_time_zone_city_model_init(HildonTimeZoneCityModel *model)
+{
+  model->stamp = g_random_int_range(1, G_MAXINT);
+}
+
+HildonTimeZoneCityModel *
+hildon_time_zone_city_model_new(Cityinfo **cities)
+{
+  HildonTimeZoneCityModel *model =
+      g_object_new(HILDON_TYPE_TIME_ZONE_CITY_MODEL, NULL);
+
+  model->cities = cities;
+
+  while (cities && cities[model->n_cities])
+    model->n_cities++;
+
+  /* only the pointer tables, strings are made on demand */
+  model->labels = g_new0(gchar *, MAX(model->n_cities, 1));
+  model->labels_checked = time(NULL);
+  model->labels_expire = HILDON_TIME_ZONE_UTC_OFFSET_NEVER;
+
+  return model;
+}
+
+HildonTimeZoneCityModel *
+hildon_time_zone_city_model_new_subset(HildonTimeZoneCityModel *model,
+                                       const guint32 *rows, gint n_rows)
+{
+  HildonTimeZoneCityModel *subset;
+
+  g_return_val_if_fail(HILDON_IS_TIME_ZONE_CITY_MODEL(model), NULL);
+  g_return_val_if_fail(model->base == NULL, NULL);
+
+  subset = g_object_new(HILDON_TYPE_TIME_ZONE_CITY_MODEL, NULL);
+  subset->base = g_object_ref(model);
+  subset->n_cities = n_rows;
+  subset->rows = g_memdup(rows, n_rows * sizeof(guint32));
+
+  return subset;
+}
+
+HildonTimeZoneSearchIndex *
+hildon_time_zone_city_model_get_search_index(HildonTimeZoneCityModel *model)
+{
+  g_return_val_if_fail(HILDON_IS_TIME_ZONE_CITY_MODEL(model), NULL);
+
+  if (model->base)
+    model = model->base;
+
+  if (!model->search_index)
+    model->search_index = hildon_time_zone_search_index_new(model->cities);
+
+  return model->search_index;
+}
+
+static guint64
+_stamp_file(guint64 stamp, const gchar *filename)
+{
+  GStatBuf st;
+
+  if (g_stat(filename, &st))
+    return stamp * 31;
+
+  return (stamp * 31 + st.st_mtime) * 31 + st.st_size;
+}
+
+/* Changes when the city or time zone data is updated. The zone files are
+ * replaced in place, the directories only change when files come or go, so
+ * the files every tzdata release rewrites are checked too. */
+static guint64
+_zone_data_stamp(void)
+{
+  const gchar *dir = g_getenv("TZDIR");
+  gchar *filename;
+  guint64 stamp;
+
+  if (!dir)
+    dir = CITY_MODEL_ZONEINFO_DIR;
+
+  stamp = _stamp_file(0, CITY_MODEL_CITYINFO_DIR);
+  stamp = _stamp_file(stamp, dir);
+
+  filename = g_build_filename(dir, "tzdata.zi", NULL);
+  stamp = _stamp_file(stamp, filename);
+  g_free(filename);
+
+  filename = g_build_filename(dir, "zone.tab", NULL);
+  stamp = _stamp_file(stamp, filename);
+  g_free(filename);
+
+  return stamp;
+}
+
+static void
+_clear_labels(HildonTimeZoneCityModel *model)
+{
+  gint i;
+
+  model->labels_checked = time(NULL);
+  model->labels_expire = HILDON_TIME_ZONE_UTC_OFFSET_NEVER;
+
+  for (i = 0; i < model->n_cities; i++)
+  {
+    g_free(model->labels[i]);
+    model->labels[i] = NULL;
+  }
+}
+
+HildonTimeZoneCityModel *
+hildon_time_zone_city_model_get_shared(void)
+{
+  const gchar *locale = setlocale(LC_MESSAGES, NULL);
+  guint64 zone_data_stamp = _zone_data_stamp();
+  time_t now = time(NULL);
+
+  /* city names and labels are translated, and UTC offsets come from the zone
+   * data */
+  if (shared_model &&
+      (g_strcmp0(shared_model->locale, locale) ||
+       shared_model->zone_data_stamp != zone_data_stamp))
+  {
+    hildon_time_zone_city_model_release_shared();
+  }
+
+  if (!shared_model)
+  {
+    shared_model = hildon_time_zone_city_model_new(cityinfo_get_all());
+    shared_model->locale = g_strdup(locale);
+    shared_model->zone_data_stamp = zone_data_stamp;
+  }
+  /* labels show the UTC offsets, kept until the first of them may change or
+   * the clock is set back */
+  else if (now >= shared_model->labels_expire ||
+           now < shared_model->labels_checked)
+  {
+    _clear_labels(shared_model);
+  }
+
+  return g_object_ref(shared_model);
+}
+
+void
+hildon_time_zone_city_model_release_shared(void)
+{
+  if (shared_model)
+  {
+    g_object_unref(shared_model);
+    shared_model = NULL;
+  }
+}
+
+gint
+hildon_time_zone_city_model_get_n_cities(HildonTimeZoneCityModel *model)
+{
+  g_return_val_if_fail(HILDON_IS_TIME_ZONE_CITY_MODEL(model), 0);
+
+  return model->n_cities;
+}
+
+const Cityinfo *
+hildon_time_zone_city_model_get_city(HildonTimeZoneCityModel *model, gint row)
+{
+  g_return_val_if_fail(HILDON_IS_TIME_ZONE_CITY_MODEL(model), NULL);
+  g_return_val_if_fail(row >= 0 && row < model->n_cities, NULL);
+
+  if (model->base)
+    return hildon_time_zone_city_model_get_city(model->base, model->rows[row]);
+
+  return model->cities[row];
+}
+
+const gchar *
+hildon_time_zone_city_model_get_label(HildonTimeZoneCityModel *model,
+                                      gint row)
+{
+  g_return_val_if_fail(HILDON_IS_TIME_ZONE_CITY_MODEL(model), NULL);
+  g_return_val_if_fail(row >= 0 && row < model->n_cities, NULL);
+
+  if (model->base)
+  {
+    return hildon_time_zone_city_model_get_label(model->base,
+                                                 model->rows[row]);
+  }
+
+  if (!model->labels[row])
+  {
+    time_t expires;
+
+    model->labels[row] =
+        hildon_time_zone_utc_offset_format_label(model->cities[row], &expires);
+    model->labels_expire = MIN(model->labels_expire, expires);
+  }
+
+  return model->labels[row];
+}
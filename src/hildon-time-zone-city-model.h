@@ -0,0 +1,133 @@
+#ifndef HILDON_TIME_ZONE_CITY_MODEL_H
+#define HILDON_TIME_ZONE_CITY_MODEL_H
+
+#include <gtk/gtk.h>
+#include <cityinfo.h>
+
+#include "hildon-time-zone-search-index.h"
+
+G_BEGIN_DECLS
+
+#define HILDON_TYPE_TIME_ZONE_CITY_MODEL \
+  (hildon_time_zone_city_model_get_type())
+#define HILDON_TIME_ZONE_CITY_MODEL(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj), HILDON_TYPE_TIME_ZONE_CITY_MODEL, \
+                              HildonTimeZoneCityModel))
+#define HILDON_IS_TIME_ZONE_CITY_MODEL(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj), HILDON_TYPE_TIME_ZONE_CITY_MODEL))
+
+typedef struct _HildonTimeZoneCityModel HildonTimeZoneCityModel;
+typedef struct _HildonTimeZoneCityModelClass HildonTimeZoneCityModelClass;
+
+/* Columns of the model. The label is the city with its UTC offset. */
+enum
+{
+  HILDON_TIME_ZONE_CITY_MODEL_COLUMN_LABEL, /* G_TYPE_STRING */
+  HILDON_TIME_ZONE_CITY_MODEL_COLUMN_CITY, /* G_TYPE_POINTER, Cityinfo */
+  HILDON_TIME_ZONE_CITY_MODEL_COLUMN_FLAGS, /* G_TYPE_INT, always 4 */
+  HILDON_TIME_ZONE_CITY_MODEL_COLUMN_NUMBER, /* G_TYPE_INT, row + 1 */
+  HILDON_TIME_ZONE_CITY_MODEL_N_COLUMNS
+};
+
+GType
+hildon_time_zone_city_model_get_type(void);
+
+/**
+ * @brief Creates a list model over an array of cities.
+ *
+ * Rows are the cities themselves, nothing is copied. Labels are built the
+ * first time a row is read and kept until the model is freed.
+ *
+ * @param cities A NULL terminated array from cityinfo_get_all(), the model
+ *               takes ownership of it.
+ *
+ * @returns A new #HildonTimeZoneCityModel.
+ */
+HildonTimeZoneCityModel *
+hildon_time_zone_city_model_new(Cityinfo **cities);
+
+/**
+ * @brief Creates a list model over some rows of another.
+ *
+ * Nothing but the row numbers is copied, labels come from @model.
+ *
+ * @param model A #HildonTimeZoneCityModel that is not a subset itself.
+ * @param rows The rows of @model to show, in order. May be NULL if @n_rows
+ *             is 0.
+ * @param n_rows The number of rows.
+ *
+ * @returns A new #HildonTimeZoneCityModel holding a reference to @model.
+ */
+HildonTimeZoneCityModel *
+hildon_time_zone_city_model_new_subset(HildonTimeZoneCityModel *model,
+                                       const guint32 *rows, gint n_rows);
+
+/**
+ * @brief Returns the search index over the cities, building it if needed.
+ *
+ * @param model A #HildonTimeZoneCityModel.
+ *
+ * @returns The index of the cities of @model, or of the model it is a subset
+ *          of. Owned by the model.
+ */
+HildonTimeZoneSearchIndex *
+hildon_time_zone_city_model_get_search_index(HildonTimeZoneCityModel *model);
+
+/**
+ * @brief Returns the model of all cities shared by the search dialogs.
+ *
+ * The model is built on first use and kept until
+ * #hildon_time_zone_city_model_release_shared(), so labels and search keys
+ * built for one dialog are there for the next. It is built again when the
+ * locale or the time zone data changed, and its labels when the UTC offsets
+ * may have. Call it before attaching views, labels are dropped without
+ * change notifications.
+ *
+ * @returns A new reference to the shared model.
+ */
+HildonTimeZoneCityModel *
+hildon_time_zone_city_model_get_shared(void);
+
+/**
+ * @brief Drops the reference the cache holds on the shared model.
+ */
+void
+hildon_time_zone_city_model_release_shared(void);
+
+/**
+ * @brief Returns the number of cities in the model.
+ *
+ * @param model A #HildonTimeZoneCityModel.
+ *
+ * @returns The number of rows.
+ */
+gint
+hildon_time_zone_city_model_get_n_cities(HildonTimeZoneCityModel *model);
+
+/**
+ * @brief Returns the city of a row.
+ *
+ * @param model A #HildonTimeZoneCityModel.
+ * @param row The row index.
+ *
+ * @returns The city, owned by the model.
+ */
+const Cityinfo *
+hildon_time_zone_city_model_get_city(HildonTimeZoneCityModel *model,
+                                     gint row);
+
+/**
+ * @brief Returns the label of a row, building it if needed.
+ *
+ * @param model A #HildonTimeZoneCityModel.
+ * @param row The row index.
+ *
+ * @returns The label, owned by the model.
+ */
+const gchar *
+hildon_time_zone_city_model_get_label(HildonTimeZoneCityModel *model,
+                                      gint row);
+
+G_END_DECLS
+
+#endif /* HILDON_TIME_ZONE_CITY_MODEL_H */
@@ -0,0 +1,304 @@
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DAYLIGHT_X86
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define DAYLIGHT_NEON
+#endif
+
+#include "hildon-time-zone-daylight.h"
+
+/* All kernels must shade alike, so products are never fused into the sums
+ * behind their back */
+#ifdef __clang__
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+#define DEG_TO_RAD (G_PI / 180.0)
+
+/* sin(6 degrees), the end of civil twilight */
+#define DAYLIGHT_TWILIGHT 0.104528
+
+/* dst[i] = clamp(a + b * c[i], 0, max) rounded half up, the shading of one
+ * row */
+typedef void (*DaylightShadeRowFn)(const float *c, float a, float b,
+                                   float max, guchar *dst, gsize n);
+
+static DaylightShadeRowFn shade_row = NULL;
+
+static void
+_shade_row_c(const float *c, float a, float b, float max, guchar *dst,
+             gsize n)
+{
+  gsize i;
+
+  for (i = 0; i < n; i++)
+    dst[i] = CLAMP(a + b * c[i], 0.0f, max) + 0.5f;
+}
+
+#ifdef DAYLIGHT_X86
+__attribute__((target("sse2"))) static void
+_shade_row_sse2(const float *c, float a, float b, float max, guchar *dst,
+                gsize n)
+{
+  const __m128 va = _mm_set1_ps(a);
+  const __m128 vb = _mm_set1_ps(b);
+  const __m128 vmax = _mm_set1_ps(max);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 half = _mm_set1_ps(0.5f);
+  gsize i;
+
+  for (i = 0; i + 16 <= n; i += 16)
+  {
+    __m128i v[4];
+    gint j;
+
+    for (j = 0; j < 4; j++)
+    {
+      __m128 s = _mm_add_ps(va, _mm_mul_ps(vb, _mm_loadu_ps(c + i + 4 * j)));
+
+      /* truncating after adding 0.5 rounds half up like the C kernel, the
+       * rounding conversion would round half to even */
+      s = _mm_add_ps(_mm_min_ps(_mm_max_ps(s, zero), vmax), half);
+      v[j] = _mm_cvttps_epi32(s);
+    }
+
+    _mm_storeu_si128((__m128i *)(dst + i),
+                     _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]),
+                                      _mm_packs_epi32(v[2], v[3])));
+  }
+
+  _shade_row_c(c + i, a, b, max, dst + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void
+_shade_row_avx2(const float *c, float a, float b, float max, guchar *dst,
+                gsize n)
+{
+  const __m256 va = _mm256_set1_ps(a);
+  const __m256 vb = _mm256_set1_ps(b);
+  const __m256 vmax = _mm256_set1_ps(max);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 half = _mm256_set1_ps(0.5f);
+  gsize i;
+
+  for (i = 0; i + 16 <= n; i += 16)
+  {
+    /* no fused multiply-add, it would round differently from the other
+     * kernels */
+    __m256 s0 = _mm256_add_ps(va, _mm256_mul_ps(vb, _mm256_loadu_ps(c + i)));
+    __m256 s1 =
+        _mm256_add_ps(va, _mm256_mul_ps(vb, _mm256_loadu_ps(c + i + 8)));
+    __m256i v0 = _mm256_cvttps_epi32(
+          _mm256_add_ps(_mm256_min_ps(_mm256_max_ps(s0, zero), vmax), half));
+    __m256i v1 = _mm256_cvttps_epi32(
+          _mm256_add_ps(_mm256_min_ps(_mm256_max_ps(s1, zero), vmax), half));
+    /* packs works per 128-bit lane, put the quadwords back in order */
+    __m256i p = _mm256_permute4x64_epi64(_mm256_packs_epi32(v0, v1), 0xd8);
+
+    _mm_storeu_si128((__m128i *)(dst + i),
+                     _mm_packus_epi16(_mm256_castsi256_si128(p),
+                                      _mm256_extracti128_si256(p, 1)));
+  }
+
+  _shade_row_sse2(c + i, a, b, max, dst + i, n - i);
+}
+#endif
+
+#ifdef DAYLIGHT_NEON
+static void
+_shade_row_neon(const float *c, float a, float b, float max, guchar *dst,
+                gsize n)
+{
+  const float32x4_t va = vdupq_n_f32(a);
+  const float32x4_t vmax = vdupq_n_f32(max);
+  const float32x4_t zero = vdupq_n_f32(0.0f);
+  const float32x4_t half = vdupq_n_f32(0.5f);
+  gsize i;
+
+  for (i = 0; i + 8 <= n; i += 8)
+  {
+    float32x4_t s0 = vaddq_f32(va, vmulq_n_f32(vld1q_f32(c + i), b));
+    float32x4_t s1 = vaddq_f32(va, vmulq_n_f32(vld1q_f32(c + i + 4), b));
+    /* the bias of 0.5 after clamping rounds the truncating conversion half
+     * up, like the C kernel */
+    uint32x4_t v0 =
+        vcvtq_u32_f32(vaddq_f32(vminq_f32(vmaxq_f32(s0, zero), vmax), half));
+    uint32x4_t v1 =
+        vcvtq_u32_f32(vaddq_f32(vminq_f32(vmaxq_f32(s1, zero), vmax), half));
+
+    vst1_u8(dst + i, vmovn_u16(vcombine_u16(vmovn_u32(v0), vmovn_u32(v1))));
+  }
+
+  _shade_row_c(c + i, a, b, max, dst + i, n - i);
+}
+#endif
+
+static void
+_init_kernels(void)
+{
+  static gsize initialized = 0;
+
+  if (!g_once_init_enter(&initialized))
+    return;
+
+  shade_row = _shade_row_c;
+
+#ifdef DAYLIGHT_X86
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2"))
+    shade_row = _shade_row_avx2;
+  else if (__builtin_cpu_supports("sse2"))
+    shade_row = _shade_row_sse2;
+#endif
+
+#ifdef DAYLIGHT_NEON
+  shade_row = _shade_row_neon;
+#endif
+
+  g_once_init_leave(&initialized, 1);
+}
+
+/* Declination of the sun and the longitude where it is noon, in radians,
+ * after the low precision formulas of the Astronomical Almanac */
+static void
+_sun_position(time_t time, double *declination, double *noon_longitude)
+{
+  double d = time / 86400.0 - 10957.5;
+  double g = (357.529 + 0.98560028 * d) * DEG_TO_RAD;
+  double q = 280.459 + 0.98564736 * d;
+  double l;
+  double e;
+  double ra;
+  double eqt;
+  double hours;
+
+  l = (q + 1.915 * sin(g) + 0.020 * sin(2 * g)) * DEG_TO_RAD;
+  e = (23.439 - 0.00000036 * d) * DEG_TO_RAD;
+  ra = atan2(cos(e) * sin(l), cos(l)) / DEG_TO_RAD;
+
+  /* equation of time in degrees, wrapped to [-180, 180) */
+  eqt = fmod(q - ra, 360.0);
+  eqt = eqt - 360.0 * floor((eqt + 180.0) / 360.0);
+  hours = fmod(time, 86400) / 3600.0;
+
+  *declination = asin(sin(e) * sin(l));
+  *noon_longitude = (15.0 * (12.0 - hours) - eqt) * DEG_TO_RAD;
+}
+
+void
+hildon_time_zone_daylight_get_map_bounds(HildonTimeZoneCityIndex *index,
+                                         HildonTimeZoneMapBounds *bounds)
+{
+  Cityinfo **cities = hildon_time_zone_city_index_get_cities(index);
+  double sx = 0.0;
+  double sy = 0.0;
+  double sxx = 0.0;
+  double syy = 0.0;
+  double slon = 0.0;
+  double slat = 0.0;
+  double sxlon = 0.0;
+  double sylat = 0.0;
+  double vx;
+  double vy;
+  gint n;
+
+  bounds->west = -180.0;
+  bounds->east = 180.0;
+  bounds->north = 90.0;
+  bounds->south = -90.0;
+
+  /* least squares fit of the coordinates against the map positions */
+  for (n = 0; cities && cities[n]; n++)
+  {
+    double x = cityinfo_get_xpos(cities[n]);
+    double y = cityinfo_get_ypos(cities[n]);
+    double lon = cityinfo_get_lon(cities[n]);
+    double lat = cityinfo_get_lat(cities[n]);
+
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    syy += y * y;
+    slon += lon;
+    slat += lat;
+    sxlon += x * lon;
+    sylat += y * lat;
+  }
+
+  vx = n * sxx - sx * sx;
+  vy = n * syy - sy * sy;
+
+  if (n >= 2 && vx > 0.0 && vy > 0.0)
+  {
+    double bx = (n * sxlon - sx * slon) / vx;
+    double by = (n * sylat - sy * slat) / vy;
+
+    bounds->west = (slon - bx * sx) / n;
+    bounds->east = bounds->west + bx;
+    bounds->north = (slat - by * sy) / n;
+    bounds->south = bounds->north + by;
+  }
+}
+
+cairo_surface_t *
+hildon_time_zone_daylight_create_mask(const HildonTimeZoneMapBounds *bounds,
+                                      gint width, gint height, time_t time,
+                                      guchar max_alpha)
+{
+  cairo_surface_t *surface;
+  double k = max_alpha / (2.0 * DAYLIGHT_TWILIGHT);
+  double declination;
+  double noon;
+  guchar *data;
+  float *c;
+  gint stride;
+  gint x;
+  gint y;
+
+  g_return_val_if_fail(width > 0 && height > 0, NULL);
+
+  _init_kernels();
+  _sun_position(time, &declination, &noon);
+
+  surface = cairo_image_surface_create(CAIRO_FORMAT_A8, width, height);
+  cairo_surface_flush(surface);
+  data = cairo_image_surface_get_data(surface);
+  stride = cairo_image_surface_get_stride(surface);
+
+  /* The sun is at sin(lat) sin(decl) + cos(lat) cos(decl) cos(lon - noon)
+   * above the horizon. The last factor only depends on the column, so each
+   * row is a linear function of it. */
+  c = g_new(float, width);
+
+  for (x = 0; x < width; x++)
+  {
+    double lon = bounds->west + (bounds->east - bounds->west) *
+        (x + 0.5) / width;
+
+    c[x] = cos(lon * DEG_TO_RAD - noon);
+  }
+
+  for (y = 0; y < height; y++)
+  {
+    double lat = (bounds->north + (bounds->south - bounds->north) *
+                  (y + 0.5) / height) * DEG_TO_RAD;
+
+    /* alpha = max * (twilight - elevation) / (2 * twilight) */
+    shade_row(c, k * (DAYLIGHT_TWILIGHT - sin(lat) * sin(declination)),
+              -k * cos(lat) * cos(declination), max_alpha,
+              data + y * stride, width);
+  }
+
+  g_free(c);
+  cairo_surface_mark_dirty(surface);
+
+  return surface;
+}
@@ -0,0 +1,56 @@
+#ifndef HILDON_TIME_ZONE_DAYLIGHT_H
+#define HILDON_TIME_ZONE_DAYLIGHT_H
+
+#include <time.h>
+#include <gdk/gdk.h>
+
+#include "hildon-time-zone-city-index.h"
+
+G_BEGIN_DECLS
+
+/* Longitude and latitude of the map edges in degrees, the world map is
+ * equirectangular */
+typedef struct
+{
+  double west;
+  double east;
+  double north;
+  double south;
+} HildonTimeZoneMapBounds;
+
+/**
+ * @brief Finds the geographic bounds of the world map from the positions of
+ *        the cities on it.
+ *
+ * @param index The cities, with both map positions and coordinates.
+ * @param bounds Return location for the bounds. The whole world is assumed if
+ *               the cities do not tell.
+ */
+void
+hildon_time_zone_daylight_get_map_bounds(HildonTimeZoneCityIndex *index,
+                                         HildonTimeZoneMapBounds *bounds);
+
+/**
+ * @brief Renders the night side of the world into an alpha mask.
+ *
+ * The mask is transparent where the sun is more than 6 degrees above the
+ * horizon and @max_alpha where it is more than 6 degrees below it. In
+ * between the alpha follows the sine of the elevation linearly, so it is
+ * half of @max_alpha on the horizon.
+ *
+ * @param bounds Geographic bounds of the map.
+ * @param width Width of the mask.
+ * @param height Height of the mask.
+ * @param time The moment to render.
+ * @param max_alpha Opacity of the night side.
+ *
+ * @returns A new CAIRO_FORMAT_A8 image surface.
+ */
+cairo_surface_t *
+hildon_time_zone_daylight_create_mask(const HildonTimeZoneMapBounds *bounds,
+                                      gint width, gint height, time_t time,
+                                      guchar max_alpha);
+
+G_END_DECLS
+
+#endif /* HILDON_TIME_ZONE_DAYLIGHT_H */
@@ -0,0 +1,319 @@
+#include <glib/gstdio.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hildon-time-zone-map-cache.h"
+
+#define MAP_CACHE_MAGIC "HTZCMAP"
+#define MAP_CACHE_VERSION 3
+#define MAP_CACHE_MAX_LEVELS 8
+#define MAP_CACHE_MAX_SIZE 16384
+#define MAP_CACHE_ALIGN(x) (((x) + 63) & ~(guint64)63)
+
+/* All fields are in host byte order, the cache is never shared between
+ * machines. Level pixel data starts at @offset and has @height rows of
+ * @rowstride bytes each. */
+typedef struct
+{
+  gchar magic[8];
+  guint32 version;
+  guint32 n_levels;
+  guint64 source_mtime;
+  guint64 source_size;
+} MapCacheHeader;
+
+typedef struct
+{
+  guint32 width;
+  guint32 height;
+  guint32 rowstride;
+  guint32 n_channels;
+  guint32 has_alpha;
+  guint32 reserved;
+  guint64 offset;
+} MapCacheLevel;
+
+static GMappedFile *cache_file = NULL;
+
+static gchar *
+_cache_filename(void)
+{
+  return g_build_filename(g_get_user_cache_dir(), "hildon-time-zone-chooser",
+                          "worldmap.cache", NULL);
+}
+
+static gboolean
+_stat_source(const gchar *source, guint64 *mtime, guint64 *size)
+{
+  GStatBuf st;
+
+  if (g_stat(source, &st))
+    return FALSE;
+
+  *mtime = st.st_mtime;
+  *size = st.st_size;
+
+  return TRUE;
+}
+
+static gboolean
+_cache_is_valid(GMappedFile *file, const gchar *source)
+{
+  const MapCacheHeader *header =
+      (const MapCacheHeader *)g_mapped_file_get_contents(file);
+  gsize length = g_mapped_file_get_length(file);
+  guint64 mtime;
+  guint64 size;
+
+  if (length < sizeof(*header) ||
+      memcmp(header->magic, MAP_CACHE_MAGIC, sizeof(header->magic)) ||
+      header->version != MAP_CACHE_VERSION ||
+      header->n_levels > MAP_CACHE_MAX_LEVELS ||
+      length < sizeof(*header) + header->n_levels * sizeof(MapCacheLevel))
+  {
+    return FALSE;
+  }
+
+  if (!_stat_source(source, &mtime, &size))
+    return FALSE;
+
+  return header->source_mtime == mtime && header->source_size == size;
+}
+
+/* Whether the level lies within the file and describes an 8-bit RGB or RGBA
+ * image GdkPixbuf can read. Levels skipped by the writer are all zero. */
+static gboolean
+_level_is_valid(const MapCacheLevel *l, guint n_levels, gsize length)
+{
+  guint64 row = (guint64)l->width * l->n_channels;
+  guint64 table_end = sizeof(MapCacheHeader) +
+      (guint64)n_levels * sizeof(MapCacheLevel);
+
+  if (!l->width || !l->height || l->width > MAP_CACHE_MAX_SIZE ||
+      l->height > MAP_CACHE_MAX_SIZE || l->has_alpha > 1 ||
+      l->n_channels != (l->has_alpha ? 4 : 3))
+  {
+    return FALSE;
+  }
+
+  if (l->rowstride < row || l->rowstride > row + 64)
+    return FALSE;
+
+  return l->offset >= table_end && l->offset <= length &&
+      (guint64)l->rowstride * l->height <= length - l->offset;
+}
+
+static void
+_unref_mapped_file(guchar *pixels, gpointer data)
+{
+  g_mapped_file_unref(data);
+}
+
+GdkPixbuf *
+hildon_time_zone_map_cache_lookup(const gchar *source, guint level)
+{
+  const MapCacheHeader *header;
+  const MapCacheLevel *l;
+  const gchar *contents;
+
+  if (cache_file && !_cache_is_valid(cache_file, source))
+    hildon_time_zone_map_cache_release();
+
+  if (!cache_file)
+  {
+    gchar *filename = _cache_filename();
+
+    cache_file = g_mapped_file_new(filename, FALSE, NULL);
+    g_free(filename);
+
+    if (!cache_file)
+      return NULL;
+
+    if (!_cache_is_valid(cache_file, source))
+    {
+      hildon_time_zone_map_cache_release();
+      return NULL;
+    }
+  }
+
+  contents = g_mapped_file_get_contents(cache_file);
+  header = (const MapCacheHeader *)contents;
+
+  if (level >= header->n_levels)
+    return NULL;
+
+  l = (const MapCacheLevel *)(contents + sizeof(*header)) + level;
+
+  /* a corrupt level is a miss, it gets rewritten with the others */
+  if (!_level_is_valid(l, header->n_levels,
+                       g_mapped_file_get_length(cache_file)))
+  {
+    return NULL;
+  }
+
+  return gdk_pixbuf_new_from_data((const guchar *)contents + l->offset,
+                                  GDK_COLORSPACE_RGB, l->has_alpha, 8,
+                                  l->width, l->height, l->rowstride,
+                                  _unref_mapped_file,
+                                  g_mapped_file_ref(cache_file));
+}
+
+static gboolean
+_write_padding(FILE *fp, guint64 len)
+{
+  static const gchar zeros[64] = {};
+
+  while (len)
+  {
+    gsize n = MIN(len, sizeof(zeros));
+
+    if (fwrite(zeros, 1, n, fp) != n)
+      return FALSE;
+
+    len -= n;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+_write_level(FILE *fp, GdkPixbuf *pixbuf)
+{
+  const guchar *pixels = gdk_pixbuf_get_pixels(pixbuf);
+  gint rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+  gint height = gdk_pixbuf_get_height(pixbuf);
+  gsize last = gdk_pixbuf_get_width(pixbuf) *
+      gdk_pixbuf_get_n_channels(pixbuf);
+  gint y;
+
+  /* the last row of a GdkPixbuf is not padded to the rowstride */
+  for (y = 0; y < height - 1; y++)
+  {
+    if (fwrite(pixels + y * rowstride, 1, rowstride, fp) != (gsize)rowstride)
+      return FALSE;
+  }
+
+  if (fwrite(pixels + y * rowstride, 1, last, fp) != last)
+    return FALSE;
+
+  return _write_padding(fp, rowstride - last);
+}
+
+gboolean
+hildon_time_zone_map_cache_store(const gchar *source, GdkPixbuf **levels,
+                                 guint n_levels)
+{
+  MapCacheHeader header = {};
+  MapCacheLevel table[MAP_CACHE_MAX_LEVELS] = {};
+  gchar *filename;
+  gchar *dirname;
+  gchar *tmpname;
+  gboolean ok = TRUE;
+  guint64 offset;
+  guint64 pos;
+  FILE *fp;
+  guint i;
+  int fd;
+
+  g_return_val_if_fail(n_levels <= MAP_CACHE_MAX_LEVELS, FALSE);
+
+  if (!_stat_source(source, &header.source_mtime, &header.source_size))
+    return FALSE;
+
+  memcpy(header.magic, MAP_CACHE_MAGIC, sizeof(header.magic));
+  header.version = MAP_CACHE_VERSION;
+  header.n_levels = n_levels;
+
+  offset = MAP_CACHE_ALIGN(sizeof(header) + n_levels * sizeof(table[0]));
+
+  for (i = 0; i < n_levels; i++)
+  {
+    GdkPixbuf *pixbuf = levels[i];
+
+    if (!pixbuf || gdk_pixbuf_get_bits_per_sample(pixbuf) != 8)
+      continue;
+
+    table[i].width = gdk_pixbuf_get_width(pixbuf);
+    table[i].height = gdk_pixbuf_get_height(pixbuf);
+    table[i].rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+    table[i].n_channels = gdk_pixbuf_get_n_channels(pixbuf);
+    table[i].has_alpha = gdk_pixbuf_get_has_alpha(pixbuf);
+    table[i].offset = offset;
+
+    offset = MAP_CACHE_ALIGN(offset +
+                             (guint64)table[i].rowstride * table[i].height);
+  }
+
+  filename = _cache_filename();
+  dirname = g_path_get_dirname(filename);
+
+  if (g_mkdir_with_parents(dirname, 0755))
+  {
+    g_free(dirname);
+    g_free(filename);
+    return FALSE;
+  }
+
+  g_free(dirname);
+
+  /* write to a temporary file and rename it, so other processes never map a
+   * partially written cache */
+  tmpname = g_strconcat(filename, ".XXXXXX", NULL);
+  fd = g_mkstemp(tmpname);
+
+  if (fd == -1)
+  {
+    g_free(tmpname);
+    g_free(filename);
+    return FALSE;
+  }
+
+  fp = fdopen(fd, "wb");
+
+  if (!fp)
+  {
+    close(fd);
+    ok = FALSE;
+    goto out;
+  }
+
+  ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+      fwrite(table, sizeof(table[0]), n_levels, fp) == n_levels;
+  pos = sizeof(header) + n_levels * sizeof(table[0]);
+
+  for (i = 0; ok && i < n_levels; i++)
+  {
+    if (!table[i].width)
+      continue;
+
+    ok = _write_padding(fp, table[i].offset - pos) &&
+        _write_level(fp, levels[i]);
+    pos = table[i].offset + (guint64)table[i].rowstride * table[i].height;
+  }
+
+  if (fclose(fp))
+    ok = FALSE;
+
+out:
+  if (!ok || g_rename(tmpname, filename))
+  {
+    g_unlink(tmpname);
+    ok = FALSE;
+  }
+
+  g_free(tmpname);
+  g_free(filename);
+
+  return ok;
+}
+
+void
+hildon_time_zone_map_cache_release()
+{
+  if (cache_file)
+  {
+    g_mapped_file_unref(cache_file);
+    cache_file = NULL;
+  }
+}
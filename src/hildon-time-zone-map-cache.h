@@ -0,0 +1,48 @@
+#ifndef HILDON_TIME_ZONE_MAP_CACHE_H
+#define HILDON_TIME_ZONE_MAP_CACHE_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief Looks up a pre-scaled world map level in the on-disk cache.
+ *
+ * @param source The image file the cache was built from.
+ * @param level The zoom level index.
+ *
+ * @returns A GdkPixbuf whose pixels live in the memory-mapped cache file, or
+ *          NULL if the cache is missing, stale or lacks @level.
+ */
+GdkPixbuf *
+hildon_time_zone_map_cache_lookup(const gchar *source, guint level);
+
+/**
+ * @brief Writes the decoded world map levels to the on-disk cache.
+ *
+ * @param source The image file the levels were decoded from.
+ * @param levels Array of @n_levels pixbufs, NULL entries are skipped.
+ * @param n_levels Number of entries in @levels.
+ *
+ * Only touches the file system, so it is safe to call from a worker thread.
+ * Call #hildon_time_zone_map_cache_release() from the main thread afterwards
+ * for the new file to be picked up by the next lookup.
+ *
+ * @returns TRUE if the cache file was written.
+ */
+gboolean
+hildon_time_zone_map_cache_store(const gchar *source, GdkPixbuf **levels,
+                                 guint n_levels);
+
+/**
+ * @brief Drops the reference the cache holds on the mapped cache file.
+ *
+ * Pixbufs previously returned by #hildon_time_zone_map_cache_lookup() stay
+ * valid, the file is unmapped once the last of them is freed.
+ */
+void
+hildon_time_zone_map_cache_release(void);
+
+G_END_DECLS
+
+#endif /* HILDON_TIME_ZONE_MAP_CACHE_H */
@@ -0,0 +1,149 @@
+#include "hildon-time-zone-map-pixmap.h"
+
+/* Rows converted per GdkImage upload, bounds the temporary client memory */
+#define MAP_PIXMAP_STRIP_HEIGHT 64
+
+static const guchar dither_matrix[4][4] = {
+  {  0,  8,  2, 10 },
+  { 12,  4, 14,  6 },
+  {  3, 11,  1,  9 },
+  { 15,  7, 13,  5 }
+};
+
+typedef struct
+{
+  gint shift;
+  gint drop;
+  guchar bias[4][4];
+} MapPixmapChannel;
+
+/* Precomputes the rounding or dither offsets added to an 8-bit value before
+ * dropping the bits @prec does not hold */
+static void
+_init_channel(MapPixmapChannel *channel, gint shift, gint prec,
+              gboolean dither)
+{
+  gint step = 1 << (8 - prec);
+  gint i;
+  gint j;
+
+  channel->shift = shift;
+  channel->drop = 8 - prec;
+
+  for (i = 0; i < 4; i++)
+  {
+    for (j = 0; j < 4; j++)
+    {
+      if (prec == 8)
+        channel->bias[i][j] = 0;
+      else if (dither)
+        channel->bias[i][j] = dither_matrix[i][j] * step / 16;
+      else
+        channel->bias[i][j] = step / 2;
+    }
+  }
+}
+
+static inline guint32
+_convert_channel(const MapPixmapChannel *channel, guchar v, gint x, gint y)
+{
+  guint c = MIN(v + channel->bias[y & 3][x & 3], 255);
+
+  return (c >> channel->drop) << channel->shift;
+}
+
+static gboolean
+_can_convert(GdkVisual *visual, GdkPixbuf *pixbuf)
+{
+  return visual && visual->type == GDK_VISUAL_TRUE_COLOR &&
+      visual->red_prec <= 8 && visual->green_prec <= 8 &&
+      visual->blue_prec <= 8 &&
+      gdk_pixbuf_get_n_channels(pixbuf) == 3 &&
+      gdk_pixbuf_get_bits_per_sample(pixbuf) == 8 &&
+      !gdk_pixbuf_get_has_alpha(pixbuf);
+}
+
+static void
+_convert_rows(GdkImage *image, GdkPixbuf *pixbuf, gint first_row,
+              gint n_rows, const MapPixmapChannel *channels, gint x, gint y)
+{
+  gint width = gdk_pixbuf_get_width(pixbuf);
+  gint rowstride = gdk_pixbuf_get_rowstride(pixbuf);
+  const guchar *pixels = gdk_pixbuf_get_pixels(pixbuf);
+  gint i;
+  gint j;
+
+  for (i = 0; i < n_rows; i++)
+  {
+    const guchar *p = pixels + (gsize)(first_row + i) * rowstride;
+    guchar *out = (guchar *)image->mem + (gsize)i * image->bpl;
+    gint dy = y + first_row + i;
+
+    for (j = 0; j < width; j++, p += 3)
+    {
+      guint32 pixel = _convert_channel(&channels[0], p[0], x + j, dy) |
+          _convert_channel(&channels[1], p[1], x + j, dy) |
+          _convert_channel(&channels[2], p[2], x + j, dy);
+
+      if (image->bpp == 2)
+        ((guint16 *)out)[j] = pixel;
+      else
+        ((guint32 *)out)[j] = pixel;
+    }
+  }
+}
+
+GdkPixmap *
+hildon_time_zone_map_pixmap_new(GdkDrawable *drawable, GdkPixbuf *pixbuf,
+                                gint x, gint y, gboolean dither)
+{
+  gint w = gdk_pixbuf_get_width(pixbuf);
+  gint h = gdk_pixbuf_get_height(pixbuf);
+  GdkVisual *visual = gdk_drawable_get_visual(drawable);
+  GdkPixmap *pixmap = gdk_pixmap_new(drawable, w, h, -1);
+  GdkImage *image = NULL;
+
+  if (_can_convert(visual, pixbuf))
+  {
+    /* a plain image, the strip is reused before a shared one would be read */
+    image = gdk_image_new(GDK_IMAGE_NORMAL, visual, w,
+                          MIN(h, MAP_PIXMAP_STRIP_HEIGHT));
+  }
+
+  if (image && (image->bpp == 2 || image->bpp == 4) &&
+      (image->byte_order == GDK_LSB_FIRST) ==
+      (G_BYTE_ORDER == G_LITTLE_ENDIAN))
+  {
+    GdkGC *gc = gdk_gc_new(GDK_DRAWABLE(pixmap));
+    MapPixmapChannel channels[3];
+    gint row;
+
+    _init_channel(&channels[0], visual->red_shift, visual->red_prec, dither);
+    _init_channel(&channels[1], visual->green_shift, visual->green_prec,
+                  dither);
+    _init_channel(&channels[2], visual->blue_shift, visual->blue_prec,
+                  dither);
+
+    for (row = 0; row < h; row += MAP_PIXMAP_STRIP_HEIGHT)
+    {
+      gint n_rows = MIN(MAP_PIXMAP_STRIP_HEIGHT, h - row);
+
+      _convert_rows(image, pixbuf, row, n_rows, channels, x, y);
+      gdk_draw_image(GDK_DRAWABLE(pixmap), gc, image, 0, 0, 0, row, w,
+                     n_rows);
+    }
+
+    g_object_unref(gc);
+  }
+  else
+  {
+    gdk_draw_pixbuf(GDK_DRAWABLE(pixmap), NULL, pixbuf, 0, 0, 0, 0, w, h,
+                    dither ? GDK_RGB_DITHER_NORMAL : GDK_RGB_DITHER_NONE,
+                    x, y);
+  }
+
+  if (image)
+    g_object_unref(image);
+
+  return pixmap;
+}
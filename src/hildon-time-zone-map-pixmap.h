@@ -0,0 +1,31 @@
+#ifndef HILDON_TIME_ZONE_MAP_PIXMAP_H
+#define HILDON_TIME_ZONE_MAP_PIXMAP_H
+
+#include <gdk/gdk.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief Uploads a world map image to a new server-side pixmap.
+ *
+ * On TrueColor visuals 24-bit RGB images are converted straight to the pixel
+ * format of the visual, for example RGB565, so the pixmap is the only copy
+ * needed for drawing. Channels with less than 8 bits can be dithered with a 4x4
+ * ordered pattern. Other images and visuals go through gdk_draw_pixbuf().
+ *
+ * @param drawable A drawable of the screen and depth to create the pixmap for.
+ * @param pixbuf The image to upload.
+ * @param x Horizontal position of @pixbuf in the whole map, aligns the dither
+ *          pattern of neighbouring images.
+ * @param y Vertical position of @pixbuf in the whole map.
+ * @param dither Whether to dither.
+ *
+ * @returns A new GdkPixmap of the size of @pixbuf.
+ */
+GdkPixmap *
+hildon_time_zone_map_pixmap_new(GdkDrawable *drawable, GdkPixbuf *pixbuf,
+                                gint x, gint y, gboolean dither);
+
+G_END_DECLS
+
+#endif /* HILDON_TIME_ZONE_MAP_PIXMAP_H */
@@ -0,0 +1,483 @@
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MAP_SCALE_X86
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define MAP_SCALE_NEON
+#endif
+
+#include "hildon-time-zone-map-scale.h"
+
+/* Downscale tap weights add up to 1 << MAP_SCALE_WEIGHT_BITS in each
+ * direction. Row sums of 8-bit pixels then still fit in 16 bits. */
+#define MAP_SCALE_WEIGHT_BITS 7
+#define MAP_SCALE_WEIGHT_ONE (1 << MAP_SCALE_WEIGHT_BITS)
+
+/* dst[i] = (a[i] + 3 * b[i] + 8) >> 4, the vertical step of the 2x upscale */
+typedef void (*MapBlendRowsFn)(const guint16 *a, const guint16 *b,
+                               guchar *dst, gsize n);
+
+/* acc[i] += src[i] * weight, the vertical step of the downscale */
+typedef void (*MapAccumulateRowFn)(const guchar *src, guint16 weight,
+                                   guint16 *acc, gsize n);
+
+static MapBlendRowsFn blend_rows = NULL;
+static MapAccumulateRowFn accumulate_row = NULL;
+
+static void
+_blend_rows_c(const guint16 *a, const guint16 *b, guchar *dst, gsize n)
+{
+  gsize i;
+
+  for (i = 0; i < n; i++)
+    dst[i] = (a[i] + 3 * b[i] + 8) >> 4;
+}
+
+static void
+_accumulate_row_c(const guchar *src, guint16 weight, guint16 *acc, gsize n)
+{
+  gsize i;
+
+  for (i = 0; i < n; i++)
+    acc[i] += src[i] * weight;
+}
+
+#ifdef MAP_SCALE_X86
+__attribute__((target("sse2"))) static void
+_blend_rows_sse2(const guint16 *a, const guint16 *b, guchar *dst, gsize n)
+{
+  const __m128i round = _mm_set1_epi16(8);
+  gsize i;
+
+  for (i = 0; i + 16 <= n; i += 16)
+  {
+    __m128i a0 = _mm_loadu_si128((const __m128i *)(a + i));
+    __m128i a1 = _mm_loadu_si128((const __m128i *)(a + i + 8));
+    __m128i b0 = _mm_loadu_si128((const __m128i *)(b + i));
+    __m128i b1 = _mm_loadu_si128((const __m128i *)(b + i + 8));
+    __m128i s0 = _mm_add_epi16(_mm_add_epi16(a0, b0),
+                               _mm_add_epi16(_mm_slli_epi16(b0, 1), round));
+    __m128i s1 = _mm_add_epi16(_mm_add_epi16(a1, b1),
+                               _mm_add_epi16(_mm_slli_epi16(b1, 1), round));
+
+    _mm_storeu_si128((__m128i *)(dst + i),
+                     _mm_packus_epi16(_mm_srli_epi16(s0, 4),
+                                      _mm_srli_epi16(s1, 4)));
+  }
+
+  _blend_rows_c(a + i, b + i, dst + i, n - i);
+}
+
+__attribute__((target("sse2"))) static void
+_accumulate_row_sse2(const guchar *src, guint16 weight, guint16 *acc, gsize n)
+{
+  const __m128i w = _mm_set1_epi16(weight);
+  const __m128i zero = _mm_setzero_si128();
+  gsize i;
+
+  for (i = 0; i + 16 <= n; i += 16)
+  {
+    __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i a0 = _mm_loadu_si128((const __m128i *)(acc + i));
+    __m128i a1 = _mm_loadu_si128((const __m128i *)(acc + i + 8));
+
+    a0 = _mm_add_epi16(a0, _mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), w));
+    a1 = _mm_add_epi16(a1, _mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), w));
+    _mm_storeu_si128((__m128i *)(acc + i), a0);
+    _mm_storeu_si128((__m128i *)(acc + i + 8), a1);
+  }
+
+  _accumulate_row_c(src + i, weight, acc + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void
+_blend_rows_avx2(const guint16 *a, const guint16 *b, guchar *dst, gsize n)
+{
+  const __m256i round = _mm256_set1_epi16(8);
+  gsize i;
+
+  for (i = 0; i + 32 <= n; i += 32)
+  {
+    __m256i a0 = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i a1 = _mm256_loadu_si256((const __m256i *)(a + i + 16));
+    __m256i b0 = _mm256_loadu_si256((const __m256i *)(b + i));
+    __m256i b1 = _mm256_loadu_si256((const __m256i *)(b + i + 16));
+    __m256i s0 = _mm256_add_epi16(
+          _mm256_add_epi16(a0, b0),
+          _mm256_add_epi16(_mm256_slli_epi16(b0, 1), round));
+    __m256i s1 = _mm256_add_epi16(
+          _mm256_add_epi16(a1, b1),
+          _mm256_add_epi16(_mm256_slli_epi16(b1, 1), round));
+    __m256i p = _mm256_packus_epi16(_mm256_srli_epi16(s0, 4),
+                                    _mm256_srli_epi16(s1, 4));
+
+    /* packus works per 128-bit lane, put the quadwords back in order */
+    _mm256_storeu_si256((__m256i *)(dst + i),
+                        _mm256_permute4x64_epi64(p, 0xd8));
+  }
+
+  _blend_rows_sse2(a + i, b + i, dst + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void
+_accumulate_row_avx2(const guchar *src, guint16 weight, guint16 *acc, gsize n)
+{
+  const __m256i w = _mm256_set1_epi16(weight);
+  gsize i;
+
+  for (i = 0; i + 16 <= n; i += 16)
+  {
+    __m256i s = _mm256_cvtepu8_epi16(
+          _mm_loadu_si128((const __m128i *)(src + i)));
+    __m256i a = _mm256_loadu_si256((const __m256i *)(acc + i));
+
+    a = _mm256_add_epi16(a, _mm256_mullo_epi16(s, w));
+    _mm256_storeu_si256((__m256i *)(acc + i), a);
+  }
+
+  _accumulate_row_c(src + i, weight, acc + i, n - i);
+}
+#endif
+
+#ifdef MAP_SCALE_NEON
+static void
+_blend_rows_neon(const guint16 *a, const guint16 *b, guchar *dst, gsize n)
+{
+  gsize i;
+
+  for (i = 0; i + 16 <= n; i += 16)
+  {
+    uint16x8_t b0 = vld1q_u16(b + i);
+    uint16x8_t b1 = vld1q_u16(b + i + 8);
+    uint16x8_t s0 = vmlaq_n_u16(vld1q_u16(a + i), b0, 3);
+    uint16x8_t s1 = vmlaq_n_u16(vld1q_u16(a + i + 8), b1, 3);
+
+    /* vrshrn adds the rounding bias before shifting */
+    vst1q_u8(dst + i, vcombine_u8(vrshrn_n_u16(s0, 4), vrshrn_n_u16(s1, 4)));
+  }
+
+  _blend_rows_c(a + i, b + i, dst + i, n - i);
+}
+
+static void
+_accumulate_row_neon(const guchar *src, guint16 weight, guint16 *acc, gsize n)
+{
+  uint8x8_t w = vdup_n_u8(weight);
+  gsize i;
+
+  for (i = 0; i + 16 <= n; i += 16)
+  {
+    uint8x16_t s = vld1q_u8(src + i);
+
+    vst1q_u16(acc + i, vmlal_u8(vld1q_u16(acc + i), vget_low_u8(s), w));
+    vst1q_u16(acc + i + 8,
+              vmlal_u8(vld1q_u16(acc + i + 8), vget_high_u8(s), w));
+  }
+
+  _accumulate_row_c(src + i, weight, acc + i, n - i);
+}
+#endif
+
+static void
+_init_kernels(void)
+{
+  static gsize initialized = 0;
+
+  if (!g_once_init_enter(&initialized))
+    return;
+
+  blend_rows = _blend_rows_c;
+  accumulate_row = _accumulate_row_c;
+
+#ifdef MAP_SCALE_X86
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2"))
+  {
+    blend_rows = _blend_rows_avx2;
+    accumulate_row = _accumulate_row_avx2;
+  }
+  else if (__builtin_cpu_supports("sse2"))
+  {
+    blend_rows = _blend_rows_sse2;
+    accumulate_row = _accumulate_row_sse2;
+  }
+#endif
+
+#ifdef MAP_SCALE_NEON
+  blend_rows = _blend_rows_neon;
+  accumulate_row = _accumulate_row_neon;
+#endif
+
+  g_once_init_leave(&initialized, 1);
+}
+
+/* out[2j] = 3 * in[j] + in[j - 1], out[2j + 1] = 3 * in[j] + in[j + 1] for
+ * @n_cols pixels starting at @x, edge pixels of the @width wide row repeated */
+static void
+_upscale_row(const guchar *src, gint width, gint x, gint n_cols,
+             guint16 *dst)
+{
+  gint i;
+  gint c;
+
+  for (i = 0; i < n_cols; i++)
+  {
+    const guchar *p = src + (x + i) * 3;
+    const guchar *l = x + i ? p - 3 : p;
+    const guchar *r = x + i < width - 1 ? p + 3 : p;
+
+    for (c = 0; c < 3; c++)
+    {
+      dst[i * 6 + c] = 3 * p[c] + l[c];
+      dst[i * 6 + 3 + c] = 3 * p[c] + r[c];
+    }
+  }
+}
+
+/* Bilinear 2x upscale sampling at pixel centers, so every output pixel is
+ * made of its source pixel and the neighbours towards it weighted 9:3:3:1.
+ * Only the @n_cols by @n_rows source pixels at @x, @y are scaled, the output
+ * matches that part of the fully scaled image. */
+static void
+_scale_up2x(const guchar *src, gint src_stride, gint width, gint height,
+            gint x, gint y, gint n_cols, gint n_rows, guchar *dst,
+            gint dst_stride)
+{
+  gsize n = (gsize)n_cols * 6;
+  guint16 *buf = g_new(guint16, 3 * n);
+  guint16 *prev = buf;
+  guint16 *cur = buf + n;
+  guint16 *next = buf + 2 * n;
+  gint i;
+
+  _upscale_row(src + MAX(y - 1, 0) * src_stride, width, x, n_cols, prev);
+  _upscale_row(src + y * src_stride, width, x, n_cols, cur);
+  _upscale_row(src + MIN(y + 1, height - 1) * src_stride, width, x, n_cols,
+               next);
+
+  for (i = 0; i < n_rows; i++)
+  {
+    guint16 *tmp;
+
+    blend_rows(prev, cur, dst + 2 * i * dst_stride, n);
+    blend_rows(next, cur, dst + (2 * i + 1) * dst_stride, n);
+
+    tmp = prev;
+    prev = cur;
+    cur = next;
+    next = tmp;
+    _upscale_row(src + MIN(y + i + 2, height - 1) * src_stride, width, x,
+                 n_cols, next);
+  }
+
+  g_free(buf);
+}
+
+typedef struct
+{
+  gint *start;
+  gint *count;
+  guint16 *weights;
+  gint max_taps;
+} MapScaleTaps;
+
+/* Area-averaging filter, every destination pixel gets the source pixels it
+ * covers weighted by the covered length */
+static void
+_compute_taps(MapScaleTaps *taps, gint src_size, gint dst_size)
+{
+  double ratio = (double)src_size / dst_size;
+  gint i;
+
+  taps->max_taps = (gint)ceil(ratio) + 1;
+  taps->start = g_new(gint, dst_size);
+  taps->count = g_new(gint, dst_size);
+  taps->weights = g_new0(guint16, (gsize)dst_size * taps->max_taps);
+
+  for (i = 0; i < dst_size; i++)
+  {
+    double x0 = i * ratio;
+    double x1 = MIN((i + 1) * ratio, src_size);
+    guint16 *w = taps->weights + (gsize)i * taps->max_taps;
+    gint start = (gint)floor(x0);
+    gint end = MIN((gint)ceil(x1), src_size);
+    gint sum = 0;
+    gint largest = 0;
+    gint j;
+
+    if (end - start > taps->max_taps)
+      end = start + taps->max_taps;
+
+    for (j = start; j < end; j++)
+    {
+      double covered = MIN(j + 1, x1) - MAX(j, x0);
+
+      w[j - start] = floor(covered / (x1 - x0) * MAP_SCALE_WEIGHT_ONE + 0.5);
+      sum += w[j - start];
+
+      if (w[j - start] > w[largest])
+        largest = j - start;
+    }
+
+    /* make the weights add up exactly */
+    w[largest] += MAP_SCALE_WEIGHT_ONE - sum;
+    taps->start[i] = start;
+    taps->count[i] = end - start;
+  }
+}
+
+static void
+_free_taps(MapScaleTaps *taps)
+{
+  g_free(taps->start);
+  g_free(taps->count);
+  g_free(taps->weights);
+}
+
+static void
+_scale_down(const guchar *src, gint src_stride, gint src_width,
+            gint src_height, guchar *dst, gint dst_stride, gint dst_width,
+            gint dst_height)
+{
+  gsize n = (gsize)src_width * 3;
+  guint16 *acc = g_new(guint16, n);
+  MapScaleTaps xtaps;
+  MapScaleTaps ytaps;
+  gint y;
+
+  _compute_taps(&xtaps, src_width, dst_width);
+  _compute_taps(&ytaps, src_height, dst_height);
+
+  for (y = 0; y < dst_height; y++)
+  {
+    const guint16 *wy = ytaps.weights + (gsize)y * ytaps.max_taps;
+    guchar *out = dst + y * dst_stride;
+    gint x;
+    gint t;
+
+    memset(acc, 0, n * sizeof(guint16));
+
+    for (t = 0; t < ytaps.count[y]; t++)
+    {
+      if (wy[t])
+      {
+        accumulate_row(src + (ytaps.start[y] + t) * src_stride, wy[t], acc,
+                       n);
+      }
+    }
+
+    for (x = 0; x < dst_width; x++)
+    {
+      const guint16 *wx = xtaps.weights + (gsize)x * xtaps.max_taps;
+      const guint16 *in = acc + xtaps.start[x] * 3;
+      guint32 r = 0;
+      guint32 g = 0;
+      guint32 b = 0;
+
+      for (t = 0; t < xtaps.count[x]; t++)
+      {
+        r += wx[t] * in[t * 3];
+        g += wx[t] * in[t * 3 + 1];
+        b += wx[t] * in[t * 3 + 2];
+      }
+
+      out[x * 3] = (r + (1 << (2 * MAP_SCALE_WEIGHT_BITS - 1))) >>
+          (2 * MAP_SCALE_WEIGHT_BITS);
+      out[x * 3 + 1] = (g + (1 << (2 * MAP_SCALE_WEIGHT_BITS - 1))) >>
+          (2 * MAP_SCALE_WEIGHT_BITS);
+      out[x * 3 + 2] = (b + (1 << (2 * MAP_SCALE_WEIGHT_BITS - 1))) >>
+          (2 * MAP_SCALE_WEIGHT_BITS);
+    }
+  }
+
+  _free_taps(&xtaps);
+  _free_taps(&ytaps);
+  g_free(acc);
+}
+
+GdkPixbuf *
+hildon_time_zone_map_scale(GdkPixbuf *src, gint width, gint height)
+{
+  gint src_width = gdk_pixbuf_get_width(src);
+  gint src_height = gdk_pixbuf_get_height(src);
+  GdkPixbuf *dst;
+
+  if (gdk_pixbuf_get_n_channels(src) != 3 ||
+      gdk_pixbuf_get_bits_per_sample(src) != 8 ||
+      gdk_pixbuf_get_has_alpha(src) ||
+      !((width == 2 * src_width && height == 2 * src_height) ||
+        (width <= src_width && height <= src_height)) ||
+      width < 1 || height < 1)
+  {
+    return gdk_pixbuf_scale_simple(src, width, height, GDK_INTERP_BILINEAR);
+  }
+
+  dst = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, width, height);
+
+  if (!dst)
+    return NULL;
+
+  _init_kernels();
+
+  if (width == 2 * src_width)
+  {
+    _scale_up2x(gdk_pixbuf_get_pixels(src), gdk_pixbuf_get_rowstride(src),
+                src_width, src_height, 0, 0, src_width, src_height,
+                gdk_pixbuf_get_pixels(dst), gdk_pixbuf_get_rowstride(dst));
+  }
+  else
+  {
+    _scale_down(gdk_pixbuf_get_pixels(src), gdk_pixbuf_get_rowstride(src),
+                src_width, src_height, gdk_pixbuf_get_pixels(dst),
+                gdk_pixbuf_get_rowstride(dst), width, height);
+  }
+
+  return dst;
+}
+
+GdkPixbuf *
+hildon_time_zone_map_scale_area(GdkPixbuf *src, gint width, gint height,
+                                gint x, gint y, gint area_width,
+                                gint area_height)
+{
+  gint src_width = gdk_pixbuf_get_width(src);
+  gint src_height = gdk_pixbuf_get_height(src);
+  GdkPixbuf *dst;
+
+  g_return_val_if_fail(x >= 0 && y >= 0 && area_width > 0 &&
+                       area_height > 0 && x + area_width <= width &&
+                       y + area_height <= height, NULL);
+
+  dst = gdk_pixbuf_new(GDK_COLORSPACE_RGB, gdk_pixbuf_get_has_alpha(src), 8,
+                       area_width, area_height);
+
+  if (!dst)
+    return NULL;
+
+  if (gdk_pixbuf_get_n_channels(src) == 3 &&
+      gdk_pixbuf_get_bits_per_sample(src) == 8 &&
+      !gdk_pixbuf_get_has_alpha(src) &&
+      width == 2 * src_width && height == 2 * src_height &&
+      !((x | y | area_width | area_height) & 1))
+  {
+    _init_kernels();
+    _scale_up2x(gdk_pixbuf_get_pixels(src), gdk_pixbuf_get_rowstride(src),
+                src_width, src_height, x / 2, y / 2, area_width / 2,
+                area_height / 2, gdk_pixbuf_get_pixels(dst),
+                gdk_pixbuf_get_rowstride(dst));
+  }
+  else
+  {
+    gdk_pixbuf_scale(src, dst, 0, 0, area_width, area_height, -x, -y,
+                     (double)width / src_width, (double)height / src_height,
+                     GDK_INTERP_BILINEAR);
+  }
+
+  return dst;
+}
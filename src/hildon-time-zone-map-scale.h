@@ -0,0 +1,48 @@
+#ifndef HILDON_TIME_ZONE_MAP_SCALE_H
+#define HILDON_TIME_ZONE_MAP_SCALE_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+/**
+ * @brief Scales a world map level.
+ *
+ * 24-bit RGB images are scaled with dedicated kernels, a 2x bilinear
+ * upscale or an area-averaging downscale, vectorized where the CPU allows.
+ * Other scales and formats fall back to gdk_pixbuf_scale_simple().
+ *
+ * @param src The image to scale.
+ * @param width Width of the new image.
+ * @param height Height of the new image.
+ *
+ * @returns A new GdkPixbuf.
+ */
+GdkPixbuf *
+hildon_time_zone_map_scale(GdkPixbuf *src, gint width, gint height);
+
+/**
+ * @brief Scales part of a world map level.
+ *
+ * Renders the @area_width by @area_height pixels at @x, @y of @src scaled to
+ * @width by @height, without scaling the rest of the image. The result is the
+ * same as that part of #hildon_time_zone_map_scale() output for the 2x kernel.
+ *
+ * @param src The image to scale.
+ * @param width Width of the whole scaled image.
+ * @param height Height of the whole scaled image.
+ * @param x Left edge of the area in the scaled image.
+ * @param y Top edge of the area in the scaled image.
+ * @param area_width Width of the area.
+ * @param area_height Height of the area.
+ *
+ * @returns A new @area_width by @area_height GdkPixbuf.
+ */
+GdkPixbuf *
+hildon_time_zone_map_scale_area(GdkPixbuf *src, gint width, gint height,
+                                gint x, gint y, gint area_width,
+                                gint area_height);
+
+G_END_DECLS
+
+#endif /* HILDON_TIME_ZONE_MAP_SCALE_H */
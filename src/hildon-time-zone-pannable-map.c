@@ -1,50 +1,221 @@
 #include <cityinfo.h>
 #include <hildon/hildon.h>
-#include <clock/clockcore-cities.h>
 #include <math.h>
+#include <time.h>
 
 #include "hildon-time-zone-pannable-map.h"
+#include "hildon-time-zone-map-cache.h"
+#include "hildon-time-zone-map-scale.h"
+#include "hildon-time-zone-map-pixmap.h"
+#include "hildon-time-zone-tiled-map.h"
+#include "hildon-time-zone-city-index.h"
+#include "hildon-time-zone-city-labels.h"
+#include "hildon-time-zone-zone-map.h"
+#include "hildon-time-zone-daylight.h"
+
+#define MAP_IMAGE_DIR "/usr/share/icons/hicolor/scalable/hildon"
+#define MAP_IMAGE_NAME "clock_worldmap_time_chooser.jpg"
+#define MAP_TILED_NAME "clock_worldmap_time_chooser.tiles"
+
+/* Size of ZOOM_NOR, the unit of map distances */
+#define MAP_WIDTH 1500
+#define MAP_HEIGHT 919
+
+/* Map positions are fractions of the map size in 0.32 fixed point, so they
+ * wrap around the map edges by integer overflow */
+#define MAP_FIXED_ONE 4294967296.0
+
+/* Dither the map when the display has less than 8 bits per channel */
+#define MAP_PIXMAP_DITHER TRUE
+
+/* Without a disk cache the map JPEG is decoded in chunks while a preview of
+ * MAP_PREVIEW_WIDTH pixels is shown */
+#define MAP_LOAD_CHUNK_SIZE (32 * 1024)
+#define MAP_PREVIEW_WIDTH 188
+
+/* Keeps ZOOM_NOR and ZOOM_HALF around when unused, and a full tile cache at
+ * 16 bits per pixel */
+#define MAP_CACHE_DEFAULT_BUDGET \
+  (8 * 1024 * 1024 + MAP_TILE_CACHE_MAX * MAP_TILE_SIZE * MAP_TILE_SIZE * 2)
+
+/* Levels scaled up from ZOOM_NOR are generated in tiles as they come into
+ * view. The cache holds the visible tiles of a full screen map together with
+ * a margin of MAP_TILE_PREFETCH tiles around them. */
+#define MAP_TILE_SIZE 256
+#define MAP_TILE_PREFETCH 1
+#define MAP_TILE_CACHE_MAX 48
+#define MAP_TILE_KEY(zoom, col, row) (((zoom) << 24) | ((row) << 12) | (col))
+
+/* City names are rendered around the view with a margin of MAP_OVERLAY_MARGIN
+ * pixels, so short pans only shift them. Markers fit the marker box of the
+ * label layout. */
+#define MAP_OVERLAY_MARGIN 128
+#define MAP_CITY_MARKER_RADIUS 2.5
+
+/* Shading of the night side. Levels above ZOOM_NOR stretch the ZOOM_NOR mask,
+ * the shading is smooth enough. */
+#define MAP_DAYLIGHT_ALPHA 112
+#define MAP_DAYLIGHT_COLOR 0.0, 0.0, 0.1
+
+/* Tint of the time zone under the crosshair */
+#define MAP_ZONE_HIGHLIGHT 1.0, 0.85, 0.3, 0.35
+
+/* Kinetic scrolling. Velocities are in map pixels per second, the public
+ * acceleration factor is in pixels per 40ms for historical reasons. */
+#define KINETIC_FRAME_INTERVAL 16
+#define KINETIC_STOP_VELOCITY 6.0
+#define KINETIC_FACTOR_RATE 25.0
+
+/* Zoom steps are animated over ZOOM_ANIMATION_TIME ms. Scale changes from
+ * outside are drawn the fast way until none came for ZOOM_SETTLE_TIME ms. */
+#define ZOOM_ANIMATION_TIME 250
+#define ZOOM_SETTLE_TIME 150
+
+enum {
+  ZOOM_HALF,
+  ZOOM_NOR,
+  ZOOM_DOUBLE,
+  ZOOM_QUAD,
+  ZOOM_LAST
+};
 
 struct _HildonPannableMap
 {
   GtkWidget *canvas;
   GdkRegion *region;
+  HildonTimeZoneCityIndex *city_index;
   int view_width;
   int view_height;
   Cityinfo *city;
   gboolean interactive;
   gboolean transparent;
-  float step;
+  float friction;
   gint zoom_factor;
   gint line_width;
-  float width;
-  float height;
+  guint32 pos_x;
+  guint32 pos_y;
   float scale;
   float cross_x;
   float cross_y;
   guint motion_timeout_id;
   guint stop_timeout_id;
-  float dest_x;
-  float dest_y;
+  guint frame_id;
+  gint64 frame_flush_time;
+  guint tile_prefetch_id;
+  guint tiles_frame;
+  guint zoom_anim_id;
+  guint zoom_settle_id;
+  gint64 zoom_anim_start;
+  float zoom_anim_from;
+  float zoom_anim_to;
+  gint zoom_anchor_x;
+  gint zoom_anchor_y;
+  float velocity_x;
+  float velocity_y;
+  gint64 frame_time;
   guint32 button_motion_time;
   guint32 button_press_time;
   float button_press_x;
   float button_press_y;
-  float button_press_x_f;
-  float button_press_y_f;
+  guint32 button_press_pos_x;
+  guint32 button_press_pos_y;
   hildon_pannable_map_update_fn update_cb;
   gpointer update_cb_data;
+  gboolean painted;
+  float painted_scale;
+  gint painted_x;
+  gint painted_y;
+  gboolean show_daylight;
+  time_t daylight_preview;
+  time_t daylight_time;
+  cairo_surface_t *daylight_masks[ZOOM_LAST];
+  gboolean highlight_zone;
+  gint zone;
+  cairo_surface_t *zone_mask;
+  gboolean show_cities;
+  cairo_surface_t *city_overlay;
+  float city_overlay_scale;
+  gint city_overlay_x;
+  gint city_overlay_y;
+  guint paint_count;
+  guint64 paint_pixels;
+  guint paint_last_pixels;
 };
 
-enum {
-  ZOOM_HALF,
-  ZOOM_NOR,
-  ZOOM_DOUBLE,
-  ZOOM_LAST
-};
+static const float zoom_scales[ZOOM_LAST] = { 0.444, 1.0, 2.0, 4.0 };
 
-static GdkPixbuf *maps_images[ZOOM_LAST] = {};
+/* Work item for the scaling thread, either a single zoom level, a tile of a
+ * scaled up level when @tile is set or, when @filename is set, all levels
+ * written to the on-disk cache. Tiles are taken from level @tiled_level of
+ * @tiled_map if set, results of an older @generation are dropped. When
+ * @city_index is set the job builds @zone_map from it instead. */
+typedef struct
+{
+  GdkPixbuf *source;
+  gint zoom_factor;
+  GdkPixbuf *result;
+  gchar *filename;
+  gboolean stored;
+  gboolean tile;
+  gint col;
+  gint row;
+  HildonTimeZoneTiledMap *tiled_map;
+  gint tiled_level;
+  guint generation;
+  HildonTimeZoneCityIndex *city_index;
+  HildonTimeZoneZoneMap *zone_map;
+} MapScaleJob;
+
+/* A zoom level shared by all maps. @pixmap is its copy in the display format,
+ * levels other than ZOOM_NOR keep only that once uploaded. @users counts the
+ * maps currently showing it, levels without users are evicted least recently
+ * used first once the cache grows past the budget. */
+typedef struct
+{
+  GdkPixbuf *pixbuf;
+  GdkPixmap *pixmap;
+  gboolean pending;
+  guint users;
+  gint64 last_used;
+} MapLevel;
+
+/* A tile of a level scaled up from ZOOM_NOR, only the server-side copy is
+ * kept. @link is its entry in the tile LRU list, @frame the last paint it was
+ * drawn in. */
+typedef struct
+{
+  guint key;
+  GdkPixmap *pixmap;
+  GList *link;
+  guint frame;
+} MapTile;
+
+static MapLevel map_levels[ZOOM_LAST] = {};
+static gsize cache_budget = MAP_CACHE_DEFAULT_BUDGET;
+static GThreadPool *scale_pool = NULL;
+static GSList *maps = NULL;
 static GdkPixbuf *cross_image = NULL;
+/* @cross_image on the display, for windows of @cross_visual */
+static cairo_surface_t *cross_surface = NULL;
+static GdkVisual *cross_visual = NULL;
+static GHashTable *map_tiles = NULL;
+static GQueue map_tiles_lru = G_QUEUE_INIT;
+static GHashTable *map_tiles_pending = NULL;
+static guint map_tiles_generation = 0;
+static guint map_tiles_frame = 0;
+static HildonTimeZoneZoneMap *zone_map = NULL;
+static gboolean zone_map_pending = FALSE;
+static GdkPixbufLoader *map_loader = NULL;
+static GMappedFile *map_loader_file = NULL;
+static gsize map_loader_offset = 0;
+static gint map_loader_rows = 0;
+static GdkPixbuf *map_preview = NULL;
+static float map_preview_scale = 0.0;
+static HildonTimeZoneTiledMap *tiled_map = NULL;
+static gboolean tiled_map_checked = FALSE;
+static HildonTimeZoneCityLabels *city_labels[ZOOM_LAST] = {};
+static HildonTimeZoneMapBounds map_bounds;
+static gboolean map_bounds_known = FALSE;
 
 static void
 stop_motion_timer(HildonPannableMap *map)
@@ -55,8 +226,8 @@ stop_motion_timer(HildonPannableMap *map)
     {
       g_source_remove(map->motion_timeout_id);
       map->motion_timeout_id = 0;
-      map->dest_x = 0.0;
-      map->dest_y = 0.0;
+      map->velocity_x = 0.0;
+      map->velocity_y = 0.0;
     }
   }
 }
@@ -77,34 +248,116 @@ hildon_pannable_map_get_city(HildonPannableMap *map)
   return NULL;
 }
 
+static guint32
+_fixed_from_fraction(double f)
+{
+  /* a fraction rounding up to 1.0 wraps to 0 */
+  return (guint32)(gint64)floor((f - floor(f)) * MAP_FIXED_ONE);
+}
+
+static guint32
+_fixed_from_pixels(double pixels, double size)
+{
+  return _fixed_from_fraction(pixels / size);
+}
+
+static double
+_fixed_to_pixels(guint32 v, double size)
+{
+  return v / MAP_FIXED_ONE * size;
+}
+
+/* Moves the map contents by the given distance in ZOOM_NOR pixels */
 static void
-do_callback(HildonPannableMap *map)
+_move_map(HildonPannableMap *map, float dx, float dy)
 {
-  double y;
-  double x;
-  Cityinfo *city;
+  map->pos_x -= _fixed_from_pixels(dx, MAP_WIDTH);
+  map->pos_y -= _fixed_from_pixels(dy, MAP_HEIGHT);
+}
+
+static gint
+_wrap_coord(gint v, gint size)
+{
+  v %= size;
+
+  return v < 0 ? v + size : v;
+}
+
+/* The highlight mask is rendered again only when the crosshair enters
+ * another zone */
+static void
+_update_zone(HildonPannableMap *map)
+{
+  gint zone;
+
+  if (!map->highlight_zone || !zone_map)
+    return;
+
+  zone = hildon_time_zone_zone_map_lookup(zone_map,
+                                          map->pos_x / MAP_FIXED_ONE,
+                                          map->pos_y / MAP_FIXED_ONE);
+
+  if (zone != map->zone)
+  {
+    map->zone = zone;
 
-  for (x = map->width / -1500.0; x >= 1.0; x -= 1.0)
-    ;
+    if (map->zone_mask)
+    {
+      cairo_surface_destroy(map->zone_mask);
+      map->zone_mask = NULL;
+    }
 
-  while (x < 0.0)
-    x += 1.0;
+    gtk_widget_queue_draw(map->canvas);
+  }
+}
 
-  for (y = map->height / -919.0; y >= 1.0; y -= 1.0)
-    ;
+static void
+do_callback(HildonPannableMap *map)
+{
+  const Cityinfo *city;
 
-  while ( y < 0.0 )
-    y += 1.0;
+  _update_zone(map);
 
-  city = clock_find_nearest_location(x, y, cityinfo_get_id(map->city));
+  city = hildon_time_zone_city_index_find_nearest(
+        map->city_index, map->pos_x / MAP_FIXED_ONE,
+        map->pos_y / MAP_FIXED_ONE, map->city);
 
   if (city)
   {
     cityinfo_free(map->city);
-    map->city = city;
+    map->city = cityinfo_clone(city);
 
     if (map->interactive && map->update_cb)
-      map->update_cb(city, map->update_cb_data);
+      map->update_cb(map->city, map->update_cb_data);
+  }
+}
+
+/* Removes all main loop sources of @map, before it is freed */
+static void
+_remove_sources(HildonPannableMap *map)
+{
+  if (map->frame_id)
+  {
+    g_source_remove(map->frame_id);
+    map->frame_id = 0;
+  }
+
+  if (map->tile_prefetch_id)
+  {
+    g_source_remove(map->tile_prefetch_id);
+    map->tile_prefetch_id = 0;
+  }
+
+  if (map->zoom_anim_id)
+  {
+    g_source_remove(map->zoom_anim_id);
+    map->zoom_anim_id = 0;
+  }
+
+  if (map->zoom_settle_id)
+  {
+    g_source_remove(map->zoom_settle_id);
+    map->zoom_settle_id = 0;
   }
 }
 
@@ -114,419 +367,2166 @@ hildon_pannable_map_redraw(HildonPannableMap *map)
   gtk_widget_queue_draw(map->canvas);
 }
 
+/* Offset of the top-left corner of the view in the map drawn at the current
+ * scale, not yet wrapped to the map size */
+static void
+_get_map_origin(HildonPannableMap *map, gint *x, gint *y)
+{
+  *x = floor(_fixed_to_pixels(map->pos_x, MAP_WIDTH * map->scale)) -
+      map->view_width / 2;
+  *y = floor(_fixed_to_pixels(map->pos_y, MAP_HEIGHT * map->scale)) -
+      map->view_height / 2;
+}
+
+/* Shortest distance from @b to @a on a circle of @size pixels */
+static gint
+_wrap_delta(gint a, gint b, gint size)
+{
+  gint d = _wrap_coord(a - b, size);
+
+  return d > size / 2 ? d - size : d;
+}
+
+static void
+_invalidate_frame(GdkWindow *window, gint x, gint y, gint w, gint h, gint lw)
+{
+  GdkRectangle r[4] = {
+    { x, y, w, lw },
+    { x, y + h - lw, w, lw },
+    { x, y, lw, h },
+    { x + w - lw, y, lw, h }
+  };
+  int i;
+
+  for (i = 0; i < 4; i++)
+    gdk_window_invalidate_rect(window, &r[i], FALSE);
+}
+
+/* Repaints the map after the view moved. The window contents are shifted by
+ * the distance moved and only the strips scrolled into view are exposed,
+ * together with the overlays which must not move with the map. */
+static void
+hildon_pannable_map_scroll(HildonPannableMap *map)
+{
+  GdkWindow *window = map->canvas->window;
+  GdkRectangle cross;
+  gint x;
+  gint y;
+  gint dx;
+  gint dy;
+
+  /* only whole pixel shifts of a sharp level can be scrolled */
+  if (!map->painted || map->painted_scale != map->scale ||
+      zoom_scales[map->zoom_factor] != map->scale || !window ||
+      !gdk_window_is_viewable(window))
+  {
+    hildon_pannable_map_redraw(map);
+    return;
+  }
+
+  /* the origin jumps by a whole level when crossing the map edge */
+  _get_map_origin(map, &x, &y);
+  dx = _wrap_delta(map->painted_x, x, MAP_WIDTH * map->scale);
+  dy = _wrap_delta(map->painted_y, y, MAP_HEIGHT * map->scale);
+
+  if (!dx && !dy)
+    return;
+
+  if (ABS(dx) >= map->view_width || ABS(dy) >= map->view_height)
+  {
+    map->painted = FALSE;
+    hildon_pannable_map_redraw(map);
+    return;
+  }
+
+  gdk_window_scroll(window, dx, dy);
+  map->painted_x = x;
+  map->painted_y = y;
+
+  if (cross_image)
+  {
+    cross.x = map->cross_x;
+    cross.y = map->cross_y;
+    cross.width = gdk_pixbuf_get_width(cross_image);
+    cross.height = gdk_pixbuf_get_height(cross_image);
+    gdk_window_invalidate_rect(window, &cross, FALSE);
+    cross.x += dx;
+    cross.y += dy;
+    gdk_window_invalidate_rect(window, &cross, FALSE);
+  }
+
+  if (map->line_width)
+  {
+    gint lw = map->line_width + 1;
+
+    _invalidate_frame(window, 0, 0, map->view_width, map->view_height, lw);
+    _invalidate_frame(window, dx, dy, map->view_width, map->view_height, lw);
+  }
+}
+
 static gboolean
 do_redraw(gpointer user_data)
 {
   HildonPannableMap *map = user_data;
-  double dest_x;
-  double dest_y;
+  gint64 now = g_get_monotonic_time();
+  float dt = (now - map->frame_time) / (float)G_USEC_PER_SEC;
+  float decay;
 
   if (!map->interactive || !map->motion_timeout_id)
     return FALSE;
 
-  map->width = map->width + map->dest_x;
-  map->height = map->height + map->dest_y;
-  map->dest_x = map->dest_x / map->step;
-  map->dest_y = map->dest_y / map->step;
+  map->frame_time = now;
+
+  /* advance by the exact integral of v(t) = v * exp(-friction * t) over the
+   * time really elapsed, so late ticks neither stall nor overshoot */
+  decay = expf(-map->friction * dt);
+  _move_map(map, map->velocity_x * (1.0 - decay) / map->friction,
+            map->velocity_y * (1.0 - decay) / map->friction);
+  map->velocity_x *= decay;
+  map->velocity_y *= decay;
+
+  if (fabsf(map->velocity_x) < KINETIC_STOP_VELOCITY)
+    map->velocity_x = 0.0;
+
+  if (fabsf(map->velocity_y) < KINETIC_STOP_VELOCITY)
+    map->velocity_y = 0.0;
 
   do_callback(map);
-  hildon_pannable_map_redraw(map);
+  hildon_pannable_map_scroll(map);
+
+  if (map->velocity_x == 0.0 && map->velocity_y == 0.0)
+  {
+    stop_motion_timer(map);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+schedule_redraw(HildonPannableMap *map)
+{
+  if (map->interactive)
+  {
+    if (!map->motion_timeout_id)
+    {
+      map->frame_time = g_get_monotonic_time();
+      map->motion_timeout_id =
+          g_timeout_add(KINETIC_FRAME_INTERVAL, do_redraw, map);
+    }
+  }
+}
+
+static gboolean
+do_frame(gpointer user_data)
+{
+  HildonPannableMap *map = user_data;
+
+  map->frame_id = 0;
+  map->frame_flush_time = g_get_monotonic_time();
+  do_callback(map);
+  hildon_pannable_map_scroll(map);
+
+  return FALSE;
+}
+
+/* Defers city resolution and repainting after a drag to the next frame, so
+ * they run at most once per KINETIC_FRAME_INTERVAL however many motion
+ * events arrive in between. Runs just before GTK processes redraws. */
+static void
+schedule_frame(HildonPannableMap *map)
+{
+  gint64 wait;
+
+  if (map->frame_id)
+    return;
+
+  wait = map->frame_flush_time + KINETIC_FRAME_INTERVAL * 1000 -
+      g_get_monotonic_time();
+
+  if (wait > 0)
+  {
+    map->frame_id = g_timeout_add_full(GDK_PRIORITY_REDRAW - 1,
+                                       wait / 1000 + 1, do_frame, map, NULL);
+  }
+  else
+  {
+    map->frame_id = g_idle_add_full(GDK_PRIORITY_REDRAW - 1, do_frame, map,
+                                    NULL);
+  }
+}
+
+void
+hildon_pannable_map_accelerate(HildonPannableMap *map, gint keyval,
+                               float factor)
+{
+  if (!map || !map->interactive)
+    return;
+
+  switch (keyval)
+  {
+    case GDK_KEY_Up:
+    {
+      map->velocity_y += factor * KINETIC_FACTOR_RATE;
+      break;
+    }
+    case GDK_KEY_Down:
+    {
+      map->velocity_y -= factor * KINETIC_FACTOR_RATE;
+      break;
+    }
+    case GDK_KEY_Right:
+    {
+      map->velocity_x -= factor * KINETIC_FACTOR_RATE;
+      break;
+    }
+    case GDK_KEY_Left:
+    {
+      map->velocity_x += factor * KINETIC_FACTOR_RATE;
+      break;
+    }
+    case GDK_KEY_Return:
+    {
+        stop_motion_timer(map);
+        return;
+    }
+  }
+
+  schedule_redraw(map);
+}
+
+void
+hildon_pannable_map_set_update_cb(HildonPannableMap *map,
+                                  hildon_pannable_map_update_fn cb,
+                                  gpointer user_data)
+{
+  map->update_cb_data = user_data;
+  map->update_cb = cb;
+}
+
+static gchar *
+_map_image_filename()
+{
+  return g_build_filename(MAP_IMAGE_DIR, MAP_IMAGE_NAME, NULL);
+}
+
+static gsize
+_pixmap_size(GdkPixmap *pixmap)
+{
+  gint w;
+  gint h;
+
+  gdk_drawable_get_size(GDK_DRAWABLE(pixmap), &w, &h);
+
+  return (gsize)w * h * (gdk_drawable_get_depth(pixmap) > 16 ? 4 : 2);
+}
+
+static gboolean
+_level_loaded(MapLevel *level)
+{
+  return level->pixbuf || level->pixmap;
+}
+
+static gsize
+_level_size(MapLevel *level)
+{
+  gsize size = 0;
+
+  if (level->pixbuf)
+  {
+    size += (gsize)gdk_pixbuf_get_rowstride(level->pixbuf) *
+        gdk_pixbuf_get_height(level->pixbuf);
+  }
+
+  if (level->pixmap)
+    size += _pixmap_size(level->pixmap);
+
+  return size;
+}
+
+static gsize
+_cache_size(void)
+{
+  gsize size = 0;
+  GList *l;
+  int i;
+
+  for (i = 0; i < ZOOM_LAST; i++)
+    size += _level_size(&map_levels[i]);
+
+  for (l = map_tiles_lru.head; l; l = l->next)
+    size += _pixmap_size(((MapTile *)l->data)->pixmap);
+
+  return size;
+}
+
+static gboolean
+_level_is_tiled(int zoom_factor)
+{
+  return zoom_scales[zoom_factor] > 1.0;
+}
+
+/* The level whose pixels are needed to show @zoom_factor */
+static int
+_level_source(int zoom_factor)
+{
+  return _level_is_tiled(zoom_factor) ? ZOOM_NOR : zoom_factor;
+}
+
+/* Returns the level of the tiled map container holding a @width by @height
+ * level, or -1. The container is optional, it provides detail beyond what
+ * scaling up ZOOM_NOR gives. */
+static gint
+_find_tiled_map_level(gint width, gint height)
+{
+  if (!tiled_map_checked)
+  {
+    gchar *filename = g_build_filename(MAP_IMAGE_DIR, MAP_TILED_NAME, NULL);
+
+    tiled_map_checked = TRUE;
+    tiled_map = hildon_time_zone_tiled_map_open(filename);
+    g_free(filename);
+
+    if (tiled_map &&
+        hildon_time_zone_tiled_map_get_tile_size(tiled_map) != MAP_TILE_SIZE)
+    {
+      g_warning("Tiled map has %d pixel tiles, %d expected",
+                hildon_time_zone_tiled_map_get_tile_size(tiled_map),
+                MAP_TILE_SIZE);
+      hildon_time_zone_tiled_map_unref(tiled_map);
+      tiled_map = NULL;
+    }
+  }
+
+  if (!tiled_map)
+    return -1;
+
+  return hildon_time_zone_tiled_map_find_level(tiled_map, width, height);
+}
+
+/* Levels up to ZOOM_DOUBLE are scaled from ZOOM_NOR, deeper ones need the
+ * tiled map container */
+static gboolean
+_level_available(int zoom_factor)
+{
+  GdkPixbuf *source = map_levels[ZOOM_NOR].pixbuf;
+
+  if (zoom_factor <= ZOOM_DOUBLE)
+    return TRUE;
+
+  if (!source)
+    return FALSE;
+
+  return _find_tiled_map_level(
+        gdk_pixbuf_get_width(source) * zoom_scales[zoom_factor],
+        gdk_pixbuf_get_height(source) * zoom_scales[zoom_factor]) >= 0;
+}
+
+static void
+_free_tile(MapTile *tile)
+{
+  g_hash_table_remove(map_tiles, GUINT_TO_POINTER(tile->key));
+  g_queue_delete_link(&map_tiles_lru, tile->link);
+  g_object_unref(tile->pixmap);
+  g_slice_free(MapTile, tile);
+}
+
+/* Tiles still being scaled are dropped when they arrive */
+static void
+_drop_tiles(void)
+{
+  while (map_tiles_lru.head)
+    _free_tile(map_tiles_lru.head->data);
 
-  dest_x = map->dest_x;
-  dest_y = map->dest_x;
+  map_tiles_generation++;
+
+  if (map_tiles_pending)
+    g_hash_table_remove_all(map_tiles_pending);
+}
+
+/* Whether @tile was drawn in the latest paint of a map showing its level */
+static gboolean
+_tile_in_view(MapTile *tile)
+{
+  GSList *l;
+
+  for (l = maps; l; l = l->next)
+  {
+    HildonPannableMap *map = l->data;
+
+    if (_level_is_tiled(map->zoom_factor) && map->tiles_frame &&
+        tile->frame == map->tiles_frame)
+    {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+static void
+_evict_level(MapLevel *level)
+{
+  if (level->pixbuf)
+  {
+    g_object_unref(level->pixbuf);
+    level->pixbuf = NULL;
+  }
+
+  if (level->pixmap)
+  {
+    g_object_unref(level->pixmap);
+    level->pixmap = NULL;
+  }
+}
+
+/* Tiles off screen go first, they are cheap to make again, then the levels
+ * without users, least recently used first. ZOOM_NOR stays, every other level
+ * and tile is scaled from it. */
+static void
+_enforce_cache_budget(void)
+{
+  gsize size = _cache_size();
+  GList *l = map_tiles_lru.tail;
+
+  while (l && size > cache_budget)
+  {
+    MapTile *tile = l->data;
+
+    l = l->prev;
+
+    if (!_tile_in_view(tile))
+    {
+      size -= _pixmap_size(tile->pixmap);
+      _free_tile(tile);
+    }
+  }
+
+  while (size > cache_budget)
+  {
+    MapLevel *lru = NULL;
+    int i;
+
+    for (i = 0; i < ZOOM_LAST; i++)
+    {
+      MapLevel *level = &map_levels[i];
+
+      if (i != ZOOM_NOR && _level_loaded(level) && !level->users &&
+          (!lru || level->last_used < lru->last_used))
+      {
+        lru = level;
+      }
+    }
+
+    if (!lru)
+      break;
+
+    size -= _level_size(lru);
+    _evict_level(lru);
+  }
+}
+
+static void
+_level_ref(int zoom_factor)
+{
+  map_levels[zoom_factor].users++;
+  map_levels[zoom_factor].last_used = g_get_monotonic_time();
+}
+
+static void
+_level_unref(int zoom_factor)
+{
+  g_assert(map_levels[zoom_factor].users > 0);
+
+  map_levels[zoom_factor].users--;
+  map_levels[zoom_factor].last_used = g_get_monotonic_time();
+  _enforce_cache_budget();
+}
+
+/* Uploads a tile scaled on the worker thread for the maps showing its level
+ * and draws it */
+static void
+_add_tile(MapScaleJob *job)
+{
+  guint key = MAP_TILE_KEY(job->zoom_factor, job->col, job->row);
+  HildonPannableMap *map = NULL;
+  MapTile *tile;
+  GSList *l;
+
+  if (job->generation != map_tiles_generation)
+    return;
+
+  g_hash_table_remove(map_tiles_pending, GUINT_TO_POINTER(key));
+
+  for (l = maps; l && !map; l = l->next)
+  {
+    map = l->data;
+
+    if (map->zoom_factor != job->zoom_factor ||
+        !GTK_WIDGET_REALIZED(map->canvas))
+    {
+      map = NULL;
+    }
+  }
+
+  if (!job->result || !map)
+    return;
+
+  if (!map_tiles)
+    map_tiles = g_hash_table_new(NULL, NULL);
+
+  tile = g_hash_table_lookup(map_tiles, GUINT_TO_POINTER(key));
+
+  if (tile)
+    _free_tile(tile);
+
+  tile = g_slice_new0(MapTile);
+  tile->key = key;
+  tile->pixmap = hildon_time_zone_map_pixmap_new(
+        GDK_DRAWABLE(map->canvas->window), job->result,
+        job->col * MAP_TILE_SIZE, job->row * MAP_TILE_SIZE,
+        MAP_PIXMAP_DITHER);
+  /* counts as in view until the map is painted again */
+  tile->frame = map->tiles_frame;
+
+  g_queue_push_head(&map_tiles_lru, tile);
+  tile->link = map_tiles_lru.head;
+  g_hash_table_insert(map_tiles, GUINT_TO_POINTER(key), tile);
+
+  while (map_tiles_lru.length > MAP_TILE_CACHE_MAX)
+    _free_tile(map_tiles_lru.tail->data);
+
+  _enforce_cache_budget();
+
+  for (l = maps; l; l = l->next)
+  {
+    HildonPannableMap *map = l->data;
+
+    if (map->zoom_factor == job->zoom_factor)
+      hildon_pannable_map_redraw(map);
+  }
+}
+
+static gboolean
+_zone_map_used(void)
+{
+  GSList *l;
+
+  for (l = maps; l; l = l->next)
+  {
+    HildonPannableMap *map = l->data;
+
+    if (map->highlight_zone)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/* Frees the zone raster once no map highlights zones anymore */
+static void
+_release_zone_map(void)
+{
+  if (!_zone_map_used())
+  {
+    hildon_time_zone_zone_map_free(zone_map);
+    zone_map = NULL;
+  }
+}
+
+/* Hands the zone raster built on the worker thread to the maps waiting for
+ * it */
+static void
+_add_zone_map(MapScaleJob *job)
+{
+  GSList *l;
+
+  zone_map_pending = FALSE;
+
+  if (!_zone_map_used())
+  {
+    hildon_time_zone_zone_map_free(job->zone_map);
+    return;
+  }
+
+  zone_map = job->zone_map;
+
+  for (l = maps; l; l = l->next)
+    _update_zone(l->data);
+}
+
+static gboolean
+_scale_done_cb(gpointer user_data)
+{
+  MapScaleJob *job = user_data;
+  GSList *l;
+
+  if (job->filename)
+  {
+    if (job->stored)
+    {
+      GdkPixbuf *pixbuf;
+
+      hildon_time_zone_map_cache_release();
+
+      /* prefer the file-backed copy, its pages can be reclaimed by the
+       * kernel */
+      if (map_levels[ZOOM_NOR].pixbuf == job->source &&
+          (pixbuf = hildon_time_zone_map_cache_lookup(job->filename,
+                                                      ZOOM_NOR)))
+      {
+        g_object_unref(map_levels[ZOOM_NOR].pixbuf);
+        map_levels[ZOOM_NOR].pixbuf = pixbuf;
+      }
+    }
+
+    g_free(job->filename);
+  }
+  else if (job->city_index)
+  {
+    _add_zone_map(job);
+    hildon_time_zone_city_index_unref(job->city_index);
+  }
+  else if (job->tile)
+  {
+    _add_tile(job);
+    hildon_time_zone_tiled_map_unref(job->tiled_map);
+
+    if (job->result)
+      g_object_unref(job->result);
+  }
+  else
+  {
+    map_levels[job->zoom_factor].pending = FALSE;
+
+    if (!_level_loaded(&map_levels[job->zoom_factor]))
+    {
+      map_levels[job->zoom_factor].pixbuf = job->result;
+      job->result = NULL;
+
+      for (l = maps; l; l = l->next)
+      {
+        HildonPannableMap *map = l->data;
+
+        if (map->zoom_factor == job->zoom_factor)
+          hildon_pannable_map_redraw(map);
+      }
+
+      _enforce_cache_budget();
+    }
+
+    if (job->result)
+      g_object_unref(job->result);
+  }
+
+  if (job->source)
+    g_object_unref(job->source);
+
+  g_slice_free(MapScaleJob, job);
+
+  return FALSE;
+}
+
+static GdkPixbuf *
+_scale_map_image(GdkPixbuf *pixbuf, int zoom_factor)
+{
+  float scale = zoom_scales[zoom_factor];
+  float w = gdk_pixbuf_get_width(pixbuf);
+  float h = gdk_pixbuf_get_height(pixbuf);
+
+  return hildon_time_zone_map_scale(pixbuf, w * scale, h * scale);
+}
+
+/* Tiles are bit-identical to the same area of the fully scaled level */
+static GdkPixbuf *
+_scale_tile(MapScaleJob *job)
+{
+  gint w = gdk_pixbuf_get_width(job->source) * zoom_scales[job->zoom_factor];
+  gint h = gdk_pixbuf_get_height(job->source) * zoom_scales[job->zoom_factor];
+  GdkPixbuf *pixbuf = NULL;
+
+  if (job->tiled_map)
+  {
+    pixbuf = hildon_time_zone_tiled_map_load_tile(job->tiled_map,
+                                                  job->tiled_level, job->col,
+                                                  job->row);
+  }
+
+  if (!pixbuf)
+  {
+    pixbuf = hildon_time_zone_map_scale_area(
+          job->source, w, h, job->col * MAP_TILE_SIZE,
+          job->row * MAP_TILE_SIZE,
+          MIN(MAP_TILE_SIZE, w - job->col * MAP_TILE_SIZE),
+          MIN(MAP_TILE_SIZE, h - job->row * MAP_TILE_SIZE));
+  }
+
+  return pixbuf;
+}
+
+static void
+_scale_thread(gpointer data, gpointer user_data)
+{
+  MapScaleJob *job = data;
+
+  if (job->filename)
+  {
+    GdkPixbuf *levels[ZOOM_LAST];
+    int i;
+
+    for (i = 0; i < ZOOM_LAST; i++)
+    {
+      if (i == ZOOM_NOR)
+        levels[i] = g_object_ref(job->source);
+      else if (_level_is_tiled(i))
+        levels[i] = NULL;
+      else
+        levels[i] = _scale_map_image(job->source, i);
+    }
+
+    job->stored =
+        hildon_time_zone_map_cache_store(job->filename, levels, ZOOM_LAST);
+
+    for (i = 0; i < ZOOM_LAST; i++)
+    {
+      if (levels[i])
+        g_object_unref(levels[i]);
+    }
+  }
+  else if (job->city_index)
+    job->zone_map = hildon_time_zone_zone_map_new(job->city_index);
+  else if (job->tile)
+    job->result = _scale_tile(job);
+  else
+    job->result = _scale_map_image(job->source, job->zoom_factor);
+
+  gdk_threads_add_idle(_scale_done_cb, job);
+}
+
+/* Levels and tiles somebody waits for go first, then the zone raster, which
+ * only the highlight needs, and writing the disk cache last */
+static gint
+_scale_job_rank(const MapScaleJob *job)
+{
+  if (job->filename)
+    return 2;
+
+  return job->city_index ? 1 : 0;
+}
+
+static gint
+_scale_job_compare(gconstpointer a, gconstpointer b, gpointer user_data)
+{
+  return _scale_job_rank(a) - _scale_job_rank(b);
+}
+
+static void
+_push_scale_job(MapScaleJob *job)
+{
+  if (!scale_pool)
+  {
+    scale_pool = g_thread_pool_new(_scale_thread, NULL, 1, FALSE, NULL);
+    g_thread_pool_set_sort_function(scale_pool, _scale_job_compare, NULL);
+  }
+
+  g_thread_pool_push(scale_pool, job, NULL);
+}
+
+/* Makes sure @zoom_factor level is loaded or on its way */
+static void
+_ensure_level(int zoom_factor)
+{
+  MapLevel *level = &map_levels[zoom_factor];
+  gchar *filename;
+
+  if (_level_loaded(level) || level->pending || zoom_factor == ZOOM_NOR ||
+      _level_is_tiled(zoom_factor))
+  {
+    return;
+  }
+
+  filename = _map_image_filename();
+  level->pixbuf = hildon_time_zone_map_cache_lookup(filename, zoom_factor);
+  g_free(filename);
+
+  if (!level->pixbuf && map_levels[ZOOM_NOR].pixbuf)
+  {
+    MapScaleJob *job = g_slice_new0(MapScaleJob);
+
+    job->source = g_object_ref(map_levels[ZOOM_NOR].pixbuf);
+    job->zoom_factor = zoom_factor;
+    level->pending = TRUE;
+    _push_scale_job(job);
+  }
+}
+
+/* The zone raster takes tens of thousands of city lookups to build when it
+ * is not cached, that is left to the worker thread */
+static void
+_ensure_zone_map(void)
+{
+  MapScaleJob *job;
+
+  if (zone_map || zone_map_pending)
+    return;
+
+  job = g_slice_new0(MapScaleJob);
+  job->city_index = hildon_time_zone_city_index_ref();
+  zone_map_pending = TRUE;
+  _push_scale_job(job);
+}
+
+static void
+create_maps_image(HildonPannableMap *map, int zoom_factor)
+{
+  _level_ref(_level_source(zoom_factor));
+  _level_unref(_level_source(map->zoom_factor));
+
+  map->zoom_factor = zoom_factor;
+  _ensure_level(zoom_factor);
+}
+
+static int
+_max_level(void)
+{
+  int zoom_factor = ZOOM_LAST - 1;
+
+  while (zoom_factor > ZOOM_NOR && !_level_available(zoom_factor))
+    zoom_factor--;
+
+  return zoom_factor;
+}
+
+/* The level to show @scale with, the first one at or above it, so the map is
+ * reduced rather than magnified */
+static int
+_sharp_level(float scale)
+{
+  int max = _max_level();
+  int i;
+
+  for (i = ZOOM_HALF; i < max; i++)
+  {
+    if (zoom_scales[i] >= scale)
+      return i;
+  }
+
+  return max;
+}
+
+static gboolean
+_is_zooming(HildonPannableMap *map)
+{
+  return map->zoom_anim_id || map->zoom_settle_id;
+}
+
+/* Changes the scale keeping the map point at @x, @y of the view in place */
+static void
+_set_scale(HildonPannableMap *map, float scale, gint x, gint y)
+{
+  float dx = x - map->view_width / 2;
+  float dy = y - map->view_height / 2;
+  int zoom_factor;
+
+  scale = CLAMP(scale, zoom_scales[ZOOM_HALF], zoom_scales[_max_level()]);
+  _move_map(map, dx / scale - dx / map->scale, dy / scale - dy / map->scale);
+  map->scale = scale;
+
+  zoom_factor = _sharp_level(scale);
+
+  if (zoom_factor != map->zoom_factor)
+    create_maps_image(map, zoom_factor);
+
+  do_callback(map);
+  hildon_pannable_map_redraw(map);
+}
+
+static gboolean
+_zoom_frame_cb(gpointer user_data)
+{
+  HildonPannableMap *map = user_data;
+  float t = (g_get_monotonic_time() - map->zoom_anim_start) /
+      (ZOOM_ANIMATION_TIME * 1000.0);
+
+  if (t >= 1.0)
+  {
+    /* the last frame is drawn sharp */
+    map->zoom_anim_id = 0;
+    _set_scale(map, map->zoom_anim_to, map->zoom_anchor_x,
+               map->zoom_anchor_y);
+
+    return FALSE;
+  }
+
+  /* ease out, interpolating the scale geometrically so the zoom speed looks
+   * the same at every scale */
+  t = 1.0 - (1.0 - t) * (1.0 - t);
+  _set_scale(map, map->zoom_anim_from *
+             powf(map->zoom_anim_to / map->zoom_anim_from, t),
+             map->zoom_anchor_x, map->zoom_anchor_y);
+
+  return TRUE;
+}
+
+/* Animates the scale to the level @zoom_factor, anchored on the crosshair.
+ * The target level starts loading right away so it is there at the end. */
+static void
+_animate_zoom(HildonPannableMap *map, int zoom_factor)
+{
+  if (map->zoom_settle_id)
+  {
+    g_source_remove(map->zoom_settle_id);
+    map->zoom_settle_id = 0;
+  }
+
+  map->zoom_anim_start = g_get_monotonic_time();
+  map->zoom_anim_from = map->scale;
+  map->zoom_anim_to = zoom_scales[zoom_factor];
+  map->zoom_anchor_x = map->view_width / 2;
+  map->zoom_anchor_y = map->view_height / 2;
+  _ensure_level(zoom_factor);
+
+  if (!map->zoom_anim_id)
+  {
+    map->zoom_anim_id =
+        g_timeout_add(KINETIC_FRAME_INTERVAL, _zoom_frame_cb, map);
+  }
+}
+
+/* The scale zoom steps go from, the target of a running animation */
+static float
+_zoom_base_scale(HildonPannableMap *map)
+{
+  return map->zoom_anim_id ? map->zoom_anim_to : map->scale;
+}
+
+void
+hildon_pannable_map_zoom_out(HildonPannableMap *map)
+{
+  int i;
+
+  if (!map)
+    return;
+
+  for (i = _max_level(); i >= ZOOM_HALF; i--)
+  {
+    if (zoom_scales[i] < _zoom_base_scale(map))
+    {
+      _animate_zoom(map, i);
+      break;
+    }
+  }
+}
+
+void
+hildon_pannable_map_zoom_in(HildonPannableMap *map)
+{
+  int max;
+  int i;
+
+  if (!map)
+    return;
+
+  max = _max_level();
+
+  for (i = ZOOM_HALF; i <= max; i++)
+  {
+    if (zoom_scales[i] > _zoom_base_scale(map))
+    {
+      _animate_zoom(map, i);
+      break;
+    }
+  }
+}
+
+static gboolean
+_zoom_settle_cb(gpointer user_data)
+{
+  HildonPannableMap *map = user_data;
+
+  map->zoom_settle_id = 0;
+  hildon_pannable_map_redraw(map);
+
+  return FALSE;
+}
+
+/* For continuous zoom gestures, the map point at @x, @y of the view stays in
+ * place. GTK 2 delivers no pinch events, the caller feeds in the scale from
+ * whatever gesture source the platform has. */
+void
+hildon_pannable_map_set_scale(HildonPannableMap *map, float scale, gint x,
+                              gint y)
+{
+  if (!map || scale <= 0.0)
+    return;
+
+  if (map->zoom_anim_id)
+  {
+    g_source_remove(map->zoom_anim_id);
+    map->zoom_anim_id = 0;
+  }
+
+  if (map->zoom_settle_id)
+    g_source_remove(map->zoom_settle_id);
+
+  map->zoom_settle_id = g_timeout_add(ZOOM_SETTLE_TIME, _zoom_settle_cb, map);
+  _set_scale(map, scale, x, y);
+}
+
+float
+hildon_pannable_map_get_scale(HildonPannableMap *map)
+{
+  if (map)
+    return map->scale;
+
+  return 1.0;
+}
+
+void
+hildon_pannable_map_set_cache_budget(gsize bytes)
+{
+  cache_budget = bytes;
+  _enforce_cache_budget();
+}
+
+gsize
+hildon_pannable_map_get_cache_size()
+{
+  return _cache_size();
+}
+
+HildonPannableMap *
+hildon_pannable_map_new_default()
+{
+  return hildon_pannable_map_new(1.2, TRUE, 1, 0);
+}
+
+GtkWidget *
+hildon_pannable_map_get_top_widget(HildonPannableMap *map)
+{
+  if (map)
+    return map->canvas;
+
+  return NULL;
+}
+
+/* Scales all zoom levels once on the worker thread and writes them to the
+ * on-disk cache, so later processes can map them instead of decoding and
+ * scaling the JPEG again. */
+static void
+_store_map_cache(const gchar *filename, GdkPixbuf *pixbuf)
+{
+  MapScaleJob *job = g_slice_new0(MapScaleJob);
+
+  job->source = g_object_ref(pixbuf);
+  job->filename = g_strdup(filename);
+  _push_scale_job(job);
+}
+
+static void
+_redraw_all_maps(void)
+{
+  GSList *l;
+
+  for (l = maps; l; l = l->next)
+    hildon_pannable_map_redraw(l->data);
+}
+
+static void
+_loader_area_updated_cb(GdkPixbufLoader *loader, gint x, gint y, gint width,
+                        gint height, gpointer user_data)
+{
+  map_loader_rows = MAX(map_loader_rows, y + height);
+  _redraw_all_maps();
+}
+
+/* Installs the decoded map as ZOOM_NOR. @error is the one the last write to
+ * the loader failed with, if any. */
+static void
+_finish_loading(GError *error)
+{
+  gchar *filename = _map_image_filename();
+  GdkPixbuf *pixbuf = NULL;
+  GSList *l;
+
+  /* closed in any case, it releases the decoder */
+  if (!gdk_pixbuf_loader_close(map_loader, error ? NULL : &error) || error)
+  {
+    g_warning("Cannot decode %s: %s", filename,
+              error ? error->message : "unknown error");
+    g_clear_error(&error);
+  }
+  else if ((pixbuf = gdk_pixbuf_loader_get_pixbuf(map_loader)))
+    g_object_ref(pixbuf);
+
+  g_object_unref(map_loader);
+  map_loader = NULL;
+  g_mapped_file_unref(map_loader_file);
+  map_loader_file = NULL;
+  map_loader_rows = 0;
+
+  if (pixbuf)
+  {
+    /* only a complete decode is worth keeping on disk */
+    _store_map_cache(filename, pixbuf);
+  }
+  else
+    pixbuf = gdk_pixbuf_new_from_file(filename, NULL);
+
+  /* the preview stays if there is no map at all */
+  if (pixbuf)
+  {
+    map_levels[ZOOM_NOR].pixbuf = pixbuf;
+    map_levels[ZOOM_NOR].last_used = g_get_monotonic_time();
+
+    if (map_preview)
+    {
+      g_object_unref(map_preview);
+      map_preview = NULL;
+    }
+  }
+
+  g_free(filename);
+
+  for (l = maps; l; l = l->next)
+    _ensure_level(((HildonPannableMap *)l->data)->zoom_factor);
+
+  _redraw_all_maps();
+}
+
+/* Feeds the next chunk of the JPEG to the loader. Runs at idle priority, so
+ * the preview and the rows decoded so far get painted in between. */
+static gboolean
+_load_chunk_cb(gpointer user_data)
+{
+  gsize length = g_mapped_file_get_length(map_loader_file);
+  gsize n = MIN(MAP_LOAD_CHUNK_SIZE, length - map_loader_offset);
+  const guchar *data =
+      (const guchar *)g_mapped_file_get_contents(map_loader_file);
+  GError *error = NULL;
+
+  if (n && gdk_pixbuf_loader_write(map_loader, data + map_loader_offset, n,
+                                   &error))
+  {
+    map_loader_offset += n;
+
+    if (map_loader_offset < length)
+      return TRUE;
+  }
+
+  _finish_loading(error);
+
+  return FALSE;
+}
+
+/* Shows a quickly decoded, downscaled preview and starts decoding the map
+ * incrementally */
+static void
+_start_loading(const gchar *filename)
+{
+  gint width = 0;
+
+  map_loader_file = g_mapped_file_new(filename, FALSE, NULL);
+  g_assert(NULL != map_loader_file);
+  map_loader_offset = 0;
+  map_loader_rows = 0;
+
+  map_loader = gdk_pixbuf_loader_new();
+  g_signal_connect(G_OBJECT(map_loader), "area-updated",
+                   G_CALLBACK(_loader_area_updated_cb), NULL);
+
+  /* kept from a failed load */
+  if (map_preview)
+  {
+    g_object_unref(map_preview);
+    map_preview = NULL;
+  }
+
+  /* the JPEG loader decodes straight at a fraction of the size */
+  if (gdk_pixbuf_get_file_info(filename, &width, NULL) && width > 0)
+  {
+    map_preview = gdk_pixbuf_new_from_file_at_scale(filename,
+                                                    MAP_PREVIEW_WIDTH, -1,
+                                                    TRUE, NULL);
+  }
+
+  if (map_preview)
+    map_preview_scale = (float)gdk_pixbuf_get_width(map_preview) / width;
+
+  g_idle_add(_load_chunk_cb, NULL);
+}
+
+static void
+_load_data(HildonPannableMap *map)
+{
+  if (!cross_image)
+  {
+    cross_image = gtk_icon_theme_load_icon(gtk_icon_theme_get_default(),
+                                           "clock_destination", 48, 0, NULL);
+
+    g_assert(NULL != cross_image);
+
+    map->cross_x =
+        0.5f * (float)(map->view_width - gdk_pixbuf_get_width(cross_image));
+    map->cross_y =
+        0.5f * (float)(map->view_height - gdk_pixbuf_get_height(cross_image));
+  }
+
+  if (!map_levels[ZOOM_NOR].pixbuf)
+  {
+    gchar *filename = _map_image_filename();
+
+    map_levels[ZOOM_NOR].pixbuf =
+        hildon_time_zone_map_cache_lookup(filename, ZOOM_NOR);
+
+    if (!map_levels[ZOOM_NOR].pixbuf && !map_loader)
+      _start_loading(filename);
+
+    g_free(filename);
+  }
+
+  map_levels[ZOOM_NOR].last_used = g_get_monotonic_time();
+  _ensure_level(map->zoom_factor);
+}
+
+/* Returns the server-side copy of @zoom_factor level, uploading it on first
+ * use. Only ZOOM_NOR is scaled into other levels and tiles, the other levels
+ * drop their pixbuf once uploaded. Returns NULL if the level must be loaded
+ * again. */
+static GdkPixmap *
+_get_level_pixmap(HildonPannableMap *map, int zoom_factor)
+{
+  GdkDrawable *window = GDK_DRAWABLE(map->canvas->window);
+  MapLevel *level = &map_levels[zoom_factor];
+
+  if (level->pixmap &&
+      gdk_drawable_get_depth(level->pixmap) != gdk_drawable_get_depth(window))
+  {
+    g_object_unref(level->pixmap);
+    level->pixmap = NULL;
+  }
+
+  if (!level->pixmap && level->pixbuf)
+  {
+    level->pixmap = hildon_time_zone_map_pixmap_new(window, level->pixbuf, 0,
+                                                    0, MAP_PIXMAP_DITHER);
+
+    if (zoom_factor != ZOOM_NOR)
+    {
+      g_object_unref(level->pixbuf);
+      level->pixbuf = NULL;
+    }
+  }
+
+  return level->pixmap;
+}
+
+/* Returns a tile of the current level, NULL if it was not made yet */
+static MapTile *
+_get_tile(HildonPannableMap *map, int zoom_factor, gint col, gint row)
+{
+  guint key = MAP_TILE_KEY(zoom_factor, col, row);
+  gint depth = gdk_drawable_get_depth(GDK_DRAWABLE(map->canvas->window));
+  MapTile *tile;
+
+  if (!map_tiles)
+    return NULL;
+
+  tile = g_hash_table_lookup(map_tiles, GUINT_TO_POINTER(key));
+
+  if (tile && gdk_drawable_get_depth(tile->pixmap) != depth)
+  {
+    _free_tile(tile);
+    tile = NULL;
+  }
+
+  if (!tile)
+    return NULL;
+
+  /* most recently used tiles stay at the head */
+  g_queue_unlink(&map_tiles_lru, tile->link);
+  g_queue_push_head_link(&map_tiles_lru, tile->link);
+
+  return tile;
+}
+
+/* Has a tile of a scaled up level made on the worker thread, from the tiled
+ * map container if it holds the level or else from ZOOM_NOR. The maps
+ * showing the level are drawn again once it is ready. */
+static void
+_request_tile(int zoom_factor, gint col, gint row)
+{
+  GdkPixbuf *source = map_levels[ZOOM_NOR].pixbuf;
+  guint key = MAP_TILE_KEY(zoom_factor, col, row);
+  MapScaleJob *job;
+  gint level;
+
+  if (!map_tiles_pending)
+    map_tiles_pending = g_hash_table_new(NULL, NULL);
+
+  if (g_hash_table_lookup(map_tiles_pending, GUINT_TO_POINTER(key)))
+    return;
+
+  job = g_slice_new0(MapScaleJob);
+  job->source = g_object_ref(source);
+  job->zoom_factor = zoom_factor;
+  job->tile = TRUE;
+  job->col = col;
+  job->row = row;
+  job->generation = map_tiles_generation;
+
+  level = _find_tiled_map_level(
+        gdk_pixbuf_get_width(source) * zoom_scales[zoom_factor],
+        gdk_pixbuf_get_height(source) * zoom_scales[zoom_factor]);
+
+  if (level >= 0)
+  {
+    job->tiled_map = hildon_time_zone_tiled_map_ref(tiled_map);
+    job->tiled_level = level;
+  }
+
+  g_hash_table_insert(map_tiles_pending, GUINT_TO_POINTER(key),
+                      GUINT_TO_POINTER(key));
+  _push_scale_job(job);
+}
+
+typedef gboolean (*MapTileFunc)(HildonPannableMap *map, int zoom_factor,
+                                gint col, gint row, gint tile_x, gint tile_y,
+                                gint x, gint y, gint width, gint height,
+                                gpointer user_data);
+
+/* Calls @func for each piece of a tile covering the given area of level
+ * @zoom_factor, wrapping around the level edges, until @func returns FALSE.
+ * @x and @y passed to @func are the unwrapped position of the piece. */
+static gboolean
+_foreach_tile(HildonPannableMap *map, int zoom_factor,
+              const GdkRectangle *area, MapTileFunc func, gpointer user_data)
+{
+  GdkPixbuf *source = map_levels[ZOOM_NOR].pixbuf;
+  gint w = gdk_pixbuf_get_width(source) * zoom_scales[zoom_factor];
+  gint h = gdk_pixbuf_get_height(source) * zoom_scales[zoom_factor];
+  gint height;
+  gint width;
+  gint x;
+  gint y;
+
+  for (y = area->y; y < area->y + area->height; y += height)
+  {
+    gint tile_y = _wrap_coord(y, h);
+    gint row = tile_y / MAP_TILE_SIZE;
+
+    tile_y -= row * MAP_TILE_SIZE;
+    height = MIN(MAP_TILE_SIZE, h - row * MAP_TILE_SIZE) - tile_y;
+    height = MIN(height, area->y + area->height - y);
+
+    for (x = area->x; x < area->x + area->width; x += width)
+    {
+      gint tile_x = _wrap_coord(x, w);
+      gint col = tile_x / MAP_TILE_SIZE;
+
+      tile_x -= col * MAP_TILE_SIZE;
+      width = MIN(MAP_TILE_SIZE, w - col * MAP_TILE_SIZE) - tile_x;
+      width = MIN(width, area->x + area->width - x);
+
+      if (!func(map, zoom_factor, col, row, tile_x, tile_y, x, y, width,
+                height, user_data))
+      {
+        return FALSE;
+      }
+    }
+  }
+
+  return TRUE;
+}
+
+/* The part of level @zoom_factor in view, not yet wrapped to the level size */
+static void
+_get_level_view(HildonPannableMap *map, int zoom_factor, GdkRectangle *area)
+{
+  float f = map->scale / zoom_scales[zoom_factor];
+  double cx =
+      _fixed_to_pixels(map->pos_x, MAP_WIDTH * zoom_scales[zoom_factor]);
+  double cy =
+      _fixed_to_pixels(map->pos_y, MAP_HEIGHT * zoom_scales[zoom_factor]);
+
+  area->x = floor(cx - map->view_width / 2 / f);
+  area->y = floor(cy - map->view_height / 2 / f);
+  area->width = ceil(map->view_width / f) + 1;
+  area->height = ceil(map->view_height / f) + 1;
+}
+
+static gboolean
+_prefetch_tile(HildonPannableMap *map, int zoom_factor, gint col, gint row,
+               gint tile_x, gint tile_y, gint x, gint y, gint width,
+               gint height, gpointer user_data)
+{
+  gint depth = gdk_drawable_get_depth(GDK_DRAWABLE(map->canvas->window));
+  gsize size = MAP_TILE_SIZE * MAP_TILE_SIZE * (depth > 16 ? 4 : 2);
+  guint pending = map_tiles_pending ? g_hash_table_size(map_tiles_pending) : 0;
+
+  if (_get_tile(map, zoom_factor, col, row))
+    return TRUE;
+
+  /* no more than the cache keeps, or they would be evicted and made again
+   * over and over */
+  if (_cache_size() + (pending + 1) * size > cache_budget)
+    return FALSE;
+
+  _request_tile(zoom_factor, col, row);
+
+  return TRUE;
+}
+
+static gboolean
+_prefetch_tiles_cb(gpointer user_data)
+{
+  HildonPannableMap *map = user_data;
+  GdkRectangle area;
+
+  if (_level_is_tiled(map->zoom_factor) && map_levels[ZOOM_NOR].pixbuf &&
+      GTK_WIDGET_REALIZED(map->canvas) && !_is_zooming(map))
+  {
+    _get_level_view(map, map->zoom_factor, &area);
+    area.x -= MAP_TILE_PREFETCH * MAP_TILE_SIZE;
+    area.y -= MAP_TILE_PREFETCH * MAP_TILE_SIZE;
+    area.width += 2 * MAP_TILE_PREFETCH * MAP_TILE_SIZE;
+    area.height += 2 * MAP_TILE_PREFETCH * MAP_TILE_SIZE;
+    _foreach_tile(map, map->zoom_factor, &area, _prefetch_tile, NULL);
+  }
+
+  map->tile_prefetch_id = 0;
+
+  return FALSE;
+}
+
+/* Stands in for a zoom level that is not ready yet by drawing @pixbuf, a copy
+ * of the map at @pixbuf_scale, scaled to the current scale. Only the first
+ * @rows rows of @pixbuf are drawn. */
+static void
+_draw_map_image_scaled(HildonPannableMap *map, cairo_t *cr,
+                       GdkPixbuf *pixbuf, float pixbuf_scale, gint rows)
+{
+  float f = map->scale / pixbuf_scale;
+  float src_x = _fixed_to_pixels(map->pos_x, MAP_WIDTH * pixbuf_scale) -
+      (map->view_width / 2) / f;
+  float src_y = _fixed_to_pixels(map->pos_y, MAP_HEIGHT * pixbuf_scale) -
+      (map->view_height / 2) / f;
+  gint h = gdk_pixbuf_get_height(pixbuf);
+
+  cairo_save(cr);
+  cairo_scale(cr, f, f);
+
+  if (rows < h)
+  {
+    /* the rows wrap around vertically like the rest of the map */
+    float y = -fmodf(src_y, h);
+
+    if (y > 0)
+      y -= h;
+
+    for (; y < map->view_height / f; y += h)
+      cairo_rectangle(cr, 0, y, map->view_width / f, rows);
+
+    cairo_clip(cr);
+  }
+
+  gdk_cairo_set_source_pixbuf(cr, pixbuf, -src_x, -src_y);
+  cairo_pattern_set_extend(cairo_get_source(cr), CAIRO_EXTEND_REPEAT);
+  /* smooth out the blocks of a heavily magnified preview */
+  cairo_pattern_set_filter(cairo_get_source(cr),
+                           f > 2.0 ? CAIRO_FILTER_BILINEAR :
+                                     CAIRO_FILTER_FAST);
+  cairo_paint(cr);
+  cairo_restore(cr);
+}
+
+/* Shows the preview, refined by the rows decoded so far, while ZOOM_NOR is
+ * being loaded */
+static void
+_draw_map_loading(HildonPannableMap *map, cairo_t *cr)
+{
+  GdkPixbuf *partial = NULL;
+
+  if (map_loader)
+    partial = gdk_pixbuf_loader_get_pixbuf(map_loader);
+
+  if (map_preview)
+  {
+    _draw_map_image_scaled(map, cr, map_preview, map_preview_scale,
+                           gdk_pixbuf_get_height(map_preview));
+  }
+
+  if (partial && map_loader_rows)
+  {
+    _draw_map_image_scaled(map, cr, partial, zoom_scales[ZOOM_NOR],
+                           map_loader_rows);
+  }
+}
+
+/* Sets up @cr so user space is level @zoom_factor, showing the map at the
+ * current scale. Sharp levels are drawn at whole pixel offsets, the same the
+ * view is scrolled by. */
+static void
+_set_level_transform(HildonPannableMap *map, cairo_t *cr, int zoom_factor)
+{
+  float f = map->scale / zoom_scales[zoom_factor];
+  double cx =
+      _fixed_to_pixels(map->pos_x, MAP_WIDTH * zoom_scales[zoom_factor]);
+  double cy =
+      _fixed_to_pixels(map->pos_y, MAP_HEIGHT * zoom_scales[zoom_factor]);
+
+  if (f == 1.0)
+  {
+    cairo_translate(cr, map->view_width / 2 - floor(cx),
+                    map->view_height / 2 - floor(cy));
+  }
+  else
+  {
+    cairo_translate(cr, map->view_width / 2, map->view_height / 2);
+    cairo_scale(cr, f, f);
+    cairo_translate(cr, -cx, -cy);
+  }
+}
+
+/* Scaled frames are sampled the cheap way while zooming and smoothed once the
+ * scale stays */
+static cairo_filter_t
+_get_level_filter(HildonPannableMap *map, int zoom_factor)
+{
+  if (map->scale == zoom_scales[zoom_factor] || _is_zooming(map))
+    return CAIRO_FILTER_FAST;
+
+  return CAIRO_FILTER_GOOD;
+}
+
+/* Stands in for a tile not made yet with the same area of ZOOM_NOR,
+ * magnified */
+static void
+_draw_tile_stand_in(HildonPannableMap *map, cairo_t *cr, int zoom_factor,
+                    gint x, gint y, gint width, gint height)
+{
+  GdkPixmap *pixmap = _get_level_pixmap(map, ZOOM_NOR);
+  double f = zoom_scales[zoom_factor] / zoom_scales[ZOOM_NOR];
+
+  if (!pixmap)
+    return;
+
+  cairo_save(cr);
+  cairo_rectangle(cr, x, y, width, height);
+  cairo_clip(cr);
+  cairo_scale(cr, f, f);
+  gdk_cairo_set_source_pixmap(cr, pixmap, 0, 0);
+  cairo_pattern_set_extend(cairo_get_source(cr), CAIRO_EXTEND_REPEAT);
+  cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_FAST);
+  cairo_paint(cr);
+  cairo_restore(cr);
+}
+
+static gboolean
+_draw_tile(HildonPannableMap *map, int zoom_factor, gint col, gint row,
+           gint tile_x, gint tile_y, gint x, gint y, gint width, gint height,
+           gpointer user_data)
+{
+  cairo_t *cr = user_data;
+  MapTile *tile = _get_tile(map, zoom_factor, col, row);
+
+  if (!tile)
+  {
+    _request_tile(zoom_factor, col, row);
+    _draw_tile_stand_in(map, cr, zoom_factor, x, y, width, height);
+    return TRUE;
+  }
+
+  tile->frame = map->tiles_frame;
+  gdk_cairo_set_source_pixmap(cr, tile->pixmap, x - tile_x, y - tile_y);
+  /* no seams between scaled tiles */
+  cairo_pattern_set_extend(cairo_get_source(cr), CAIRO_EXTEND_PAD);
+  cairo_pattern_set_filter(cairo_get_source(cr),
+                           _get_level_filter(map, zoom_factor));
+  cairo_rectangle(cr, x, y, width, height);
+  cairo_fill(cr);
+
+  return TRUE;
+}
+
+/* Draws the tiles of a scaled up level intersecting @damage, standing in for
+ * the missing ones until the worker thread made them, then has the tiles
+ * around the view made in the background.
+ * The damaged rectangles are gone through one by one so tiles only inside
+ * the bounding box of an L-shaped damage are not generated. */
+static void
+_draw_map_tiles(HildonPannableMap *map, cairo_t *cr, int zoom_factor,
+                const GdkRegion *damage)
+{
+  GdkRectangle *rects;
+  gint n_rects;
+  gint i;
+
+  gdk_region_get_rectangles(damage, &rects, &n_rects);
+  map->tiles_frame = ++map_tiles_frame;
+
+  for (i = 0; i < n_rects; i++)
+  {
+    GdkRectangle area;
+    double x1 = rects[i].x;
+    double y1 = rects[i].y;
+    double x2 = rects[i].x + rects[i].width;
+    double y2 = rects[i].y + rects[i].height;
+
+    cairo_save(cr);
+    cairo_identity_matrix(cr);
+    cairo_rectangle(cr, x1, y1, x2 - x1, y2 - y1);
+    cairo_restore(cr);
+    cairo_save(cr);
+    cairo_clip(cr);
+    cairo_clip_extents(cr, &x1, &y1, &x2, &y2);
+    area.x = floor(x1);
+    area.y = floor(y1);
+    area.width = ceil(x2) - area.x;
+    area.height = ceil(y2) - area.y;
+
+    _foreach_tile(map, zoom_factor, &area, _draw_tile, cr);
+    cairo_restore(cr);
+  }
+
+  g_free(rects);
+
+  if (!map->tile_prefetch_id)
+  {
+    map->tile_prefetch_id =
+        g_idle_add_full(G_PRIORITY_LOW, _prefetch_tiles_cb, map, NULL);
+  }
+}
+
+/* Fills the view with the level pixmap, repeated across the map edges */
+static void
+_draw_map_level(HildonPannableMap *map, cairo_t *cr, int zoom_factor,
+                GdkPixmap *pixmap)
+{
+  gdk_cairo_set_source_pixmap(cr, pixmap, 0, 0);
+  cairo_pattern_set_extend(cairo_get_source(cr), CAIRO_EXTEND_REPEAT);
+  cairo_pattern_set_filter(cairo_get_source(cr),
+                           _get_level_filter(map, zoom_factor));
+  cairo_paint(cr);
+}
+
+/* Draws the map at the current scale from the sharp level if possible. While
+ * zooming, tiled levels are stood in for by ZOOM_NOR as generating tiles
+ * costs more than a frame, and so are levels still being scaled. */
+static void
+_draw_map_image(HildonPannableMap *map, cairo_t *cr, const GdkRegion *damage)
+{
+  int zoom_factor = map->zoom_factor;
+  GdkPixmap *pixmap = NULL;
+
+  if (!map_levels[ZOOM_NOR].pixbuf)
+  {
+    _draw_map_loading(map, cr);
+    return;
+  }
 
-  if (dest_x <= 0.0)
-    dest_x = -dest_x;
+  if (_level_is_tiled(zoom_factor) &&
+      map->scale != zoom_scales[zoom_factor] && _is_zooming(map))
+  {
+    zoom_factor = ZOOM_NOR;
+  }
 
-  if (dest_x < 0.24)
+  if (!_level_is_tiled(zoom_factor))
   {
-    dest_y = 0.0;
-    map->dest_x = 0.0;
+    pixmap = _get_level_pixmap(map, zoom_factor);
+
+    if (!pixmap)
+    {
+      _ensure_level(zoom_factor);
+      zoom_factor = ZOOM_NOR;
+      pixmap = _get_level_pixmap(map, zoom_factor);
+    }
   }
 
-  if (fabsf(map->dest_y) < 0.24)
-    map->dest_y = 0.0;
+  cairo_save(cr);
+  _set_level_transform(map, cr, zoom_factor);
 
-  if (fabs(dest_y) >= 0.24)
-    return TRUE;
+  if (pixmap)
+    _draw_map_level(map, cr, zoom_factor, pixmap);
+  else
+    _draw_map_tiles(map, cr, zoom_factor, damage);
+
+  cairo_restore(cr);
+}
+
+static void
+_drop_daylight_masks(HildonPannableMap *map)
+{
+  int i;
 
-  if (fabsf(map->dest_y) < 0.24)
+  for (i = 0; i < ZOOM_LAST; i++)
   {
-    stop_motion_timer(map);
-    return FALSE;
+    if (map->daylight_masks[i])
+    {
+      cairo_surface_destroy(map->daylight_masks[i]);
+      map->daylight_masks[i] = NULL;
+    }
   }
-
-  return TRUE;
 }
 
+/* The shading changes once a minute, or when another time is previewed */
 static void
-schedule_redraw(HildonPannableMap *map)
+_update_daylight(HildonPannableMap *map)
 {
-  if (map->interactive)
+  time_t t = map->daylight_preview ? map->daylight_preview : time(NULL);
+
+  t -= t % 60;
+
+  if (map->show_daylight && t != map->daylight_time)
   {
-    if (!map->motion_timeout_id)
-      map->motion_timeout_id = g_timeout_add(40, do_redraw, map);
+    map->daylight_time = t;
+    _drop_daylight_masks(map);
+    hildon_pannable_map_redraw(map);
   }
 }
 
-void
-hildon_pannable_map_accelerate(HildonPannableMap *map, gint keyval,
-                               float factor)
+/* Shades the night side with the mask of the current level, rendered on the
+ * first expose after the time changed and kept on the display, so panning
+ * only composites it. Returns the number of pixels drawn. */
+static guint
+_draw_daylight(HildonPannableMap *map, cairo_t *cr, guint damage_area)
 {
-  if (!map || !map->interactive)
-    return;
+  int zoom_factor = MIN(map->zoom_factor, ZOOM_NOR);
+  cairo_surface_t **mask = &map->daylight_masks[zoom_factor];
+  cairo_pattern_t *pattern;
 
-  switch (keyval)
+  if (!map->show_daylight || !map_levels[ZOOM_NOR].pixbuf)
+    return 0;
+
+  if (!*mask)
   {
-    case GDK_KEY_Up:
-    {
-      map->dest_y += factor;
-      break;
-    }
-    case GDK_KEY_Down:
-    {
-      map->dest_y -= factor;
-      break;
-    }
-    case GDK_KEY_Right:
-    {
-      map->dest_x -= factor;
-      break;
-    }
-    case GDK_KEY_Left:
-    {
-      map->dest_x += factor;
-      break;
-    }
-    case GDK_KEY_Return:
+    gint w = MAP_WIDTH * zoom_scales[zoom_factor];
+    gint h = MAP_HEIGHT * zoom_scales[zoom_factor];
+    cairo_surface_t *image;
+    cairo_t *mask_cr;
+
+    if (!map_bounds_known)
     {
-        stop_motion_timer(map);
-        return;
+      hildon_time_zone_daylight_get_map_bounds(map->city_index, &map_bounds);
+      map_bounds_known = TRUE;
     }
+
+    image = hildon_time_zone_daylight_create_mask(
+          &map_bounds, w, h, map->daylight_time, MAP_DAYLIGHT_ALPHA);
+    *mask = cairo_surface_create_similar(cairo_get_target(cr),
+                                         CAIRO_CONTENT_ALPHA, w, h);
+    mask_cr = cairo_create(*mask);
+    cairo_set_source_surface(mask_cr, image, 0, 0);
+    cairo_set_operator(mask_cr, CAIRO_OPERATOR_SOURCE);
+    cairo_paint(mask_cr);
+    cairo_destroy(mask_cr);
+    cairo_surface_destroy(image);
   }
 
-  schedule_redraw(map);
-}
+  cairo_save(cr);
+  _set_level_transform(map, cr, zoom_factor);
 
-void
-hildon_pannable_map_set_update_cb(HildonPannableMap *map,
-                                  hildon_pannable_map_update_fn cb,
-                                  gpointer user_data)
-{
-  map->update_cb_data = user_data;
-  map->update_cb = cb;
+  pattern = cairo_pattern_create_for_surface(*mask);
+  cairo_pattern_set_extend(pattern, CAIRO_EXTEND_REPEAT);
+  cairo_pattern_set_filter(pattern, _get_level_filter(map, zoom_factor));
+  cairo_set_source_rgb(cr, MAP_DAYLIGHT_COLOR);
+  cairo_mask(cr, pattern);
+  cairo_pattern_destroy(pattern);
+  cairo_restore(cr);
+
+  return damage_area;
 }
 
-static void
-create_maps_image(HildonPannableMap *map, int zoom_factor)
+/* Tints the zone under the crosshair. The mask of the zone is kept on the
+ * display and stretched over the map. Returns the number of pixels drawn. */
+static guint
+_draw_zone_highlight(HildonPannableMap *map, cairo_t *cr, guint damage_area)
 {
-  float scale;
-  float w;
-  float h;
+  cairo_pattern_t *pattern;
+  gint w;
+  gint h;
 
-  if (zoom_factor == ZOOM_DOUBLE)
+  if (!map->highlight_zone || !zone_map || map->zone < 0 ||
+      !map_levels[ZOOM_NOR].pixbuf)
   {
-    scale = 2.0;
-    map->scale = scale;
+    return 0;
   }
-  else if (zoom_factor == ZOOM_NOR)
+
+  hildon_time_zone_zone_map_get_size(zone_map, &w, &h);
+
+  if (!map->zone_mask)
   {
-    map->scale = 1.0;
-    return;
+    cairo_surface_t *image =
+        hildon_time_zone_zone_map_create_mask(zone_map, map->zone);
+    cairo_t *mask_cr;
+
+    map->zone_mask = cairo_surface_create_similar(
+          cairo_get_target(cr), CAIRO_CONTENT_ALPHA, w, h);
+    mask_cr = cairo_create(map->zone_mask);
+    cairo_set_source_surface(mask_cr, image, 0, 0);
+    cairo_set_operator(mask_cr, CAIRO_OPERATOR_SOURCE);
+    cairo_paint(mask_cr);
+    cairo_destroy(mask_cr);
+    cairo_surface_destroy(image);
   }
-  else
-    map->scale = 0.444;
 
-  if (!maps_images[zoom_factor])
-  {
-    w = gdk_pixbuf_get_width(maps_images[ZOOM_NOR]);
-    h = gdk_pixbuf_get_height(maps_images[ZOOM_NOR]);
+  cairo_save(cr);
+  _set_level_transform(map, cr, ZOOM_NOR);
+  cairo_scale(cr, (double)MAP_WIDTH / w, (double)MAP_HEIGHT / h);
 
-    maps_images[zoom_factor] = gdk_pixbuf_scale_simple(
-          maps_images[ZOOM_NOR], w * map->scale, h * map->scale,
-          GDK_INTERP_BILINEAR);
-  }
+  pattern = cairo_pattern_create_for_surface(map->zone_mask);
+  cairo_pattern_set_extend(pattern, CAIRO_EXTEND_REPEAT);
+  cairo_pattern_set_filter(pattern, CAIRO_FILTER_GOOD);
+  cairo_set_source_rgba(cr, MAP_ZONE_HIGHLIGHT);
+  cairo_mask(cr, pattern);
+  cairo_pattern_destroy(pattern);
+  cairo_restore(cr);
+
+  return damage_area;
 }
 
-void
-hildon_pannable_map_zoom_out(HildonPannableMap *map)
+/* The labels point at the cities of the index, so they go with it */
+static void
+_free_city_labels(void)
 {
-  if (map)
-  {
-    int zoom_factor = map->zoom_factor - 1;
-
-    map->zoom_factor = zoom_factor;
+  int i;
 
-    if (zoom_factor >= 0)
-    {
-      create_maps_image(map, zoom_factor);
-      hildon_pannable_map_redraw(map);
-    }
-    else
-      map->zoom_factor = ZOOM_HALF;
+  for (i = 0; i < ZOOM_LAST; i++)
+  {
+    hildon_time_zone_city_labels_free(city_labels[i]);
+    city_labels[i] = NULL;
   }
 }
 
-void
-hildon_pannable_map_zoom_in(HildonPannableMap *map)
+/* City labels are placed once per level for all maps */
+static HildonTimeZoneCityLabels *
+_get_city_labels(HildonPannableMap *map, int zoom_factor)
 {
-  if (map)
+  if (!city_labels[zoom_factor])
   {
-    int zoom_factor = map->zoom_factor + 1;
-
-    map->zoom_factor = zoom_factor;
-
-    if (zoom_factor > ZOOM_DOUBLE)
-      map->zoom_factor = ZOOM_DOUBLE;
-    else
-    {
-      if (zoom_factor == ZOOM_NOR)
-      {
-        g_object_unref(maps_images[ZOOM_HALF]);
-        maps_images[ZOOM_HALF] = 0;
-        zoom_factor = map->zoom_factor;
-      }
+    PangoLayout *layout = gtk_widget_create_pango_layout(map->canvas, NULL);
 
-      create_maps_image(map, zoom_factor);
-      hildon_pannable_map_redraw(map);
-    }
+    city_labels[zoom_factor] = hildon_time_zone_city_labels_new(
+          map->city_index, layout, MAP_WIDTH * zoom_scales[zoom_factor],
+          MAP_HEIGHT * zoom_scales[zoom_factor]);
+    g_object_unref(layout);
   }
-}
 
-HildonPannableMap *
-hildon_pannable_map_new_default()
-{
-  return hildon_pannable_map_new(1.2, TRUE, 1, 0);
+  return city_labels[zoom_factor];
 }
 
-GtkWidget *
-hildon_pannable_map_get_top_widget(HildonPannableMap *map)
+typedef struct
 {
-  if (map)
-    return map->canvas;
+  cairo_t *cr;
+  PangoLayout *layout;
+} MapOverlayDraw;
 
-  return NULL;
+static void
+_draw_city_label(const Cityinfo *city, gint x, gint y,
+                 const GdkRectangle *label, gpointer user_data)
+{
+  MapOverlayDraw *draw = user_data;
+  cairo_t *cr = draw->cr;
+  PangoLayout *layout = draw->layout;
+
+  cairo_arc(cr, x, y, MAP_CITY_MARKER_RADIUS, 0.0, 2 * G_PI);
+  cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+  cairo_fill_preserve(cr);
+  cairo_set_source_rgb(cr, 0.0, 0.0, 0.0);
+  cairo_set_line_width(cr, 1.0);
+  cairo_stroke(cr);
+
+  pango_layout_set_text(layout, cityinfo_get_name(city), -1);
+
+  /* the shadow keeps names readable on light parts of the map */
+  cairo_set_source_rgba(cr, 0.0, 0.0, 0.0, 0.6);
+  cairo_move_to(cr, label->x + 1, label->y + 1);
+  pango_cairo_show_layout(cr, layout);
+  cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+  cairo_move_to(cr, label->x, label->y);
+  pango_cairo_show_layout(cr, layout);
 }
 
+/* Renders the cities around the view origin @x, @y into the overlay */
 static void
-_draw_transaprent_background(HildonPannableMap *map)
+_render_city_overlay(HildonPannableMap *map, cairo_t *target, gint x, gint y)
 {
-  GtkWidget *parent;
-
-  if (!map->transparent)
-    return;
-
-  parent = gtk_widget_get_parent(map->canvas);
+  GdkRectangle area;
+  MapOverlayDraw draw;
 
-  if (!parent)
-    return;
+  area.x = x - MAP_OVERLAY_MARGIN;
+  area.y = y - MAP_OVERLAY_MARGIN;
+  area.width = map->view_width + 2 * MAP_OVERLAY_MARGIN;
+  area.height = map->view_height + 2 * MAP_OVERLAY_MARGIN;
 
-  if (map->transparent)
+  if (!map->city_overlay)
   {
-    cairo_t *cr = gdk_cairo_create(GDK_DRAWABLE(parent));
-    cairo_rectangle(cr, map->canvas->allocation.x + 2,
-                    map->canvas->allocation.y + map->line_width + 2,
-                    map->view_width + 2, map->view_height);
-    cairo_set_source_rgba(cr, 0.0, 0.0, 0.0, 0.25);
-    cairo_fill(cr);
-    cairo_destroy(cr);
+    map->city_overlay = cairo_surface_create_similar(
+          cairo_get_target(target), CAIRO_CONTENT_COLOR_ALPHA, area.width,
+          area.height);
   }
+
+  draw.cr = cairo_create(map->city_overlay);
+  cairo_set_operator(draw.cr, CAIRO_OPERATOR_CLEAR);
+  cairo_paint(draw.cr);
+  cairo_set_operator(draw.cr, CAIRO_OPERATOR_OVER);
+  cairo_translate(draw.cr, -area.x, -area.y);
+  /* the font labels were placed with */
+  draw.layout = gtk_widget_create_pango_layout(map->canvas, NULL);
+
+  hildon_time_zone_city_labels_foreach(
+        _get_city_labels(map, map->zoom_factor), &area, _draw_city_label,
+        &draw);
+
+  g_object_unref(draw.layout);
+  cairo_destroy(draw.cr);
+
+  map->city_overlay_scale = map->scale;
+  map->city_overlay_x = area.x;
+  map->city_overlay_y = area.y;
 }
 
-static void
-_load_data(HildonPannableMap *map)
+/* Draws the city markers and names over sharp levels, the overlay is rendered
+ * again only when the view leaves it. Returns the number of pixels drawn. */
+static guint
+_draw_city_overlay(HildonPannableMap *map, cairo_t *cr, guint damage_area)
 {
-  if (!cross_image || !maps_images[ZOOM_NOR])
+  gint w = MAP_WIDTH * map->scale;
+  gint h = MAP_HEIGHT * map->scale;
+  gint x;
+  gint y;
+  gint dx;
+  gint dy;
+
+  if (!map->show_cities || !map_levels[ZOOM_NOR].pixbuf ||
+      map->scale != zoom_scales[map->zoom_factor])
   {
-    gchar *filename;
-
-    cross_image = gtk_icon_theme_load_icon(gtk_icon_theme_get_default(),
-                                           "clock_destination", 48, 0, NULL);
+    return 0;
+  }
 
-    g_assert(NULL != cross_image);
+  _get_map_origin(map, &x, &y);
 
-    filename = g_build_filename("/usr/share/icons/hicolor/scalable/hildon",
-                                "clock_worldmap_time_chooser.jpg", NULL);
-    maps_images[ZOOM_NOR] = gdk_pixbuf_new_from_file(filename, NULL);
+  /* the overlay repeats with the map, any copy of the view will do */
+  dx = _wrap_coord(x - map->city_overlay_x, w);
+  dy = _wrap_coord(y - map->city_overlay_y, h);
 
-    g_assert(NULL != maps_images[ZOOM_NOR]);
-    g_free(filename);
-    map->cross_x =
-        0.5f * (float)(map->view_width - gdk_pixbuf_get_width(cross_image));
-    map->cross_y =
-        0.5f * (float)(map->view_height - gdk_pixbuf_get_height(cross_image));
+  if (!map->city_overlay || map->city_overlay_scale != map->scale ||
+      dx + map->view_width > map->view_width + 2 * MAP_OVERLAY_MARGIN ||
+      dy + map->view_height > map->view_height + 2 * MAP_OVERLAY_MARGIN)
+  {
+    _render_city_overlay(map, cr, x, y);
+    dx = MAP_OVERLAY_MARGIN;
+    dy = MAP_OVERLAY_MARGIN;
   }
+
+  cairo_set_source_surface(cr, map->city_overlay, -dx, -dy);
+  cairo_paint(cr);
+
+  return damage_area;
 }
 
-static void
-_draw_map_image(HildonPannableMap *map)
+/* Pixels of @rect inside @region */
+static guint
+_region_area(const GdkRegion *region, const GdkRectangle *rect)
 {
-  gint view_w;
-  gint view_h;
-  gint width;
-  gint height;
-  gint dest_y;
-  gint dest_x;
-  gint src_x;
-  gint src_y;
-  gint h;
-  gint w;
+  GdkRegion *part = gdk_region_rectangle(rect);
+  GdkRectangle *rects;
+  gint n_rects;
+  guint area = 0;
+  gint i;
 
-  if (!maps_images[ZOOM_NOR])
-    return;
+  gdk_region_intersect(part, region);
+  gdk_region_get_rectangles(part, &rects, &n_rects);
 
-  w = gdk_pixbuf_get_width(maps_images[map->zoom_factor]);
-  h = gdk_pixbuf_get_height(maps_images[map->zoom_factor]);
+  for (i = 0; i < n_rects; i++)
+    area += rects[i].width * rects[i].height;
 
-  view_w = map->view_width;
-  view_h = map->view_height;
+  g_free(rects);
+  gdk_region_destroy(part);
 
-  src_x = (map->scale * -map->width) - view_w / 2;
-  src_y = (map->scale * -map->height) - view_h / 2;
+  return area;
+}
 
-  if (src_x < 0)
-  {
-    gint i = src_x + w;
+/* The crosshair is kept in a surface of the display, with its alpha.
+ * Returns the number of pixels drawn. */
+static guint
+_draw_cross_image(HildonPannableMap *map, cairo_t *cr,
+                  const GdkRegion *damage)
+{
+  GdkVisual *visual = gtk_widget_get_visual(map->canvas);
+  GdkRectangle rect;
+  guint area;
 
-    do
-    {
-      src_x = i;
-      i += w;
-    }
-    while (i - w < 0);
-  }
+  if (!cross_image)
+    return 0;
 
-  if (src_y < 0)
-  {
-    gint i = src_y + h;
+  /* the crosshair can sit on half pixels */
+  rect.x = floor(map->cross_x);
+  rect.y = floor(map->cross_y);
+  rect.width = gdk_pixbuf_get_width(cross_image) + 1;
+  rect.height = gdk_pixbuf_get_height(cross_image) + 1;
+  area = _region_area(damage, &rect);
 
-    do
-    {
-      src_y = i;
-      i += h;
-    }
-    while (i - h < 0);
-  }
+  if (!area)
+    return 0;
 
-  if (w < src_x)
+  if (cross_surface && cross_visual != visual)
   {
-    gint i = src_x - w;
-
-    do
-    {
-      src_x = i;
-      i -= w;
-    }
-    while (w < i + w);
+    cairo_surface_destroy(cross_surface);
+    cross_surface = NULL;
   }
 
-  if (h < src_y)
+  if (!cross_surface)
   {
-    gint i = src_y - h;
-
-    do
-    {
-      src_y = i;
-      i -= h;
-    }
-    while (h < i + h);
+    cairo_t *surface_cr;
+
+    cross_surface = cairo_surface_create_similar(
+          cairo_get_target(cr), CAIRO_CONTENT_COLOR_ALPHA,
+          gdk_pixbuf_get_width(cross_image),
+          gdk_pixbuf_get_height(cross_image));
+    surface_cr = cairo_create(cross_surface);
+    gdk_cairo_set_source_pixbuf(surface_cr, cross_image, 0, 0);
+    cairo_set_operator(surface_cr, CAIRO_OPERATOR_SOURCE);
+    cairo_paint(surface_cr);
+    cairo_destroy(surface_cr);
+    cross_visual = visual;
   }
 
-  dest_y = 0;
-
-  do
-  {
-    if (h + dest_y > view_h)
-      height = view_h - dest_y;
-    else
-      height = h;
-
-    if (h < src_y + height)
-      height = h - src_y;
+  cairo_set_source_surface(cr, cross_surface, map->cross_x, map->cross_y);
+  cairo_rectangle(cr, rect.x, rect.y, rect.width, rect.height);
+  cairo_fill(cr);
 
-    dest_x = 0;
-
-    do
-    {
-      if (w + dest_x <= view_w)
-        width = w;
-      else
-        width = view_w - dest_x;
+  return area;
+}
 
-      if (w < width + src_x)
-        width = w - src_x;
+/* Returns the number of pixels drawn */
+static guint
+_draw_border(HildonPannableMap *map, cairo_t *cr, const GdkRegion *damage)
+{
+  GdkRectangle view = { 0, 0, map->view_width, map->view_height };
+  GdkRectangle inside;
+  guint area;
 
-      gdk_draw_pixbuf(GDK_DRAWABLE(map->canvas->window), NULL,
-                      maps_images[map->zoom_factor],
-                      src_x, src_y, dest_x, dest_y, width, height,
-                      GDK_RGB_DITHER_NONE, 0, 0);
+  if (!map->line_width)
+    return 0;
 
-      dest_x += width;
-      view_w = map->view_width;
-      src_x = 0;
-    }
-    while (dest_x < view_w);
+  inside.x = map->line_width;
+  inside.y = map->line_width;
+  inside.width = MAX(map->view_width - 2 * map->line_width, 0);
+  inside.height = MAX(map->view_height - 2 * map->line_width, 0);
+  area = _region_area(damage, &view) - _region_area(damage, &inside);
 
-    dest_y += height;
-    view_h = map->view_height;
-    src_y = 0;
+  if (area)
+  {
+    cairo_set_source_rgb(cr, 0.0, 0.0, 0.0);
+    cairo_set_line_width(cr, map->line_width);
+    cairo_set_line_join(cr, CAIRO_LINE_JOIN_MITER);
+    cairo_rectangle(cr, map->line_width / 2.0, map->line_width / 2.0,
+                    map->view_width - map->line_width,
+                    map->view_height - map->line_width);
+    cairo_stroke(cr);
   }
-  while (dest_y < view_h);
-}
-
-static void
-_draw_cross_image(HildonPannableMap *map)
-{
-  if (!cross_image)
-    return;
 
-  gdk_draw_pixbuf(GDK_DRAWABLE(map->canvas->window), NULL, cross_image,
-                  0, 0, map->cross_x, map->cross_y,
-                  gdk_pixbuf_get_width(cross_image),
-                  gdk_pixbuf_get_height(cross_image),
-                  GDK_RGB_DITHER_NONE, 0, 0);
+  return area;
 }
 
-static void
-_draw_border(HildonPannableMap *map)
+/* Dims the map when it is shown as a background. Returns the number of pixels
+ * drawn. */
+static guint
+_draw_transaprent_background(HildonPannableMap *map, cairo_t *cr,
+                             guint damage_area)
 {
-  if (map->line_width)
-  {
-    static GdkGC *gc = NULL;
-
-    if (!gc )
-    {
-      GdkColor color = {};
+  if (!map->transparent)
+    return 0;
 
-      gc = gdk_gc_new(GDK_DRAWABLE(map->canvas->window));
-      gdk_gc_set_foreground(gc, &color);
-    }
+  cairo_set_source_rgba(cr, 0.0, 0.0, 0.0, 0.25);
+  cairo_paint(cr);
 
-    gdk_gc_set_line_attributes(gc, map->line_width, GDK_LINE_SOLID,
-                               GDK_CAP_BUTT, GDK_JOIN_MITER);
-    gdk_draw_rectangle(GDK_DRAWABLE(map->canvas->window), gc, FALSE, 0, 0,
-                       map->view_width - 1, map->view_height - 1);
-  }
+  return damage_area;
 }
 
+/* Only the part of the view in the expose region is drawn, every step is
+ * clipped to it and skipped if it lies outside */
 static gboolean
 _canvas_expose_cb(GtkWidget *widget, GdkEventExpose *event,
                   HildonPannableMap *map)
 {
+  GdkRectangle view = { 0, 0, map->view_width, map->view_height };
+  GdkRegion *damage;
+  guint damage_area;
+  guint pixels;
+  cairo_t *cr;
+
   _load_data(map);
 
-  gdk_window_begin_paint_region(map->canvas->window, map->region);
+  damage = gdk_region_copy(event->region);
+
+  if (map->region)
+    gdk_region_intersect(damage, map->region);
+
+  damage_area = _region_area(damage, &view);
+
+  if (!damage_area)
+  {
+    gdk_region_destroy(damage);
+    return 0;
+  }
+
+  gdk_window_begin_paint_region(map->canvas->window, damage);
+
+  cr = gdk_cairo_create(GDK_DRAWABLE(map->canvas->window));
+  gdk_cairo_region(cr, damage);
+  cairo_clip(cr);
 
-  _draw_map_image(map);
-  _draw_cross_image(map);
-  _draw_border(map);
-  _draw_transaprent_background(map);
+  _draw_map_image(map, cr, damage);
+  pixels = damage_area;
+  pixels += _draw_daylight(map, cr, damage_area);
+  pixels += _draw_zone_highlight(map, cr, damage_area);
+  pixels += _draw_city_overlay(map, cr, damage_area);
+
+  /* overlays are fixed to the view and drawn after the map */
+  pixels += _draw_cross_image(map, cr, damage);
+  pixels += _draw_border(map, cr, damage);
+  pixels += _draw_transaprent_background(map, cr, damage_area);
+
+  cairo_destroy(cr);
 
   gdk_window_end_paint(map->canvas->window);
 
+  map->paint_count++;
+  map->paint_pixels += pixels;
+  map->paint_last_pixels = pixels;
+
+  if (damage_area == (guint)(map->view_width * map->view_height))
+    map->painted = TRUE;
+
+  gdk_region_destroy(damage);
+
+  map->painted_scale = map->scale;
+  _get_map_origin(map, &map->painted_x, &map->painted_y);
+
   return 0;
 }
 
+/* Number of exposes drawn so far, the pixels drawn by all of them, counting
+ * overlapping overlays separately, and the pixels drawn by the last one */
+void
+hildon_pannable_map_get_paint_stats(HildonPannableMap *map, guint *exposes,
+                                    guint64 *pixels, guint *last_pixels)
+{
+  if (!map)
+    return;
+
+  if (exposes)
+    *exposes = map->paint_count;
+
+  if (pixels)
+    *pixels = map->paint_pixels;
+
+  if (last_pixels)
+    *last_pixels = map->paint_last_pixels;
+}
+
 static gboolean
 _canvas_configure_cb(GtkWidget *widget, GdkEventConfigure *event,
                      HildonPannableMap *map)
@@ -541,6 +2541,13 @@ _canvas_configure_cb(GtkWidget *widget, GdkEventConfigure *event,
     map->region = NULL;
   }
 
+  if (map->city_overlay)
+  {
+    cairo_surface_destroy(map->city_overlay);
+    map->city_overlay = NULL;
+  }
+
+  map->painted = FALSE;
   rectangle.x = 0;
   rectangle.y = 0;
   rectangle.width = widget->allocation.width;
@@ -583,10 +2590,12 @@ _canvas_button_press_cb(GtkWidget *widget, GdkEventButton *event,
   map->button_press_time = event->time;
   map->button_press_x = event->x;
   map->button_press_y = event->y;
-  map->button_press_x_f = map->width -
-      (map->button_press_x - (float)(map->view_width / 2)) / map->scale;
-  map->button_press_y_f = map->height -
-      (map->button_press_y - (float)(map->view_height / 2)) / map->scale;
+  map->button_press_pos_x = map->pos_x + _fixed_from_pixels(
+        (map->button_press_x - (float)(map->view_width / 2)) / map->scale,
+        MAP_WIDTH);
+  map->button_press_pos_y = map->pos_y + _fixed_from_pixels(
+        (map->button_press_y - (float)(map->view_height / 2)) / map->scale,
+        MAP_HEIGHT);
 
   return FALSE;
 }
@@ -597,10 +2606,10 @@ stop_redraw(gpointer user_data)
   HildonPannableMap *map = user_data;
 
   stop_motion_timer(map);
-  map->width = map->button_press_x_f;
-  map->height = map->button_press_y_f;
+  map->pos_x = map->button_press_pos_x;
+  map->pos_y = map->button_press_pos_y;
   do_callback(map);
-  hildon_pannable_map_redraw(map);
+  hildon_pannable_map_scroll(map);
   map->stop_timeout_id = 0;
 
   return FALSE;
@@ -625,7 +2634,8 @@ _canvas_button_release_cb(GtkWidget *widget, GdkEventButton *event,
   map->button_press_y = 0.0;
 
   if ((event->time - button_motion_time < 200) &&
-      (fabsf(map->dest_x) > 0.24 || fabsf(map->dest_y) > 0.24))
+      (fabsf(map->velocity_x) > KINETIC_STOP_VELOCITY ||
+       fabsf(map->velocity_y) > KINETIC_STOP_VELOCITY))
   {
       schedule_redraw(map);
   }
@@ -646,19 +2656,20 @@ _canvas_motion_notify_cb(GtkWidget *widget, GdkEventMotion *event,
     if (dt <= 0.0)
       dt = 1.0;
 
-    map->width = map->width + dx;
-    map->height = map->height + dy;
-    map->dest_x = dx * 40.0 / dt * 0.3 + 0.7 * map->dest_x;
-    map->dest_y = 0.7 * map->dest_y + 0.3 * (40.0 * dy / dt);
+    _move_map(map, dx, dy);
+    map->velocity_x = 0.3 * (1000.0 * dx / dt) + 0.7 * map->velocity_x;
+    map->velocity_y = 0.3 * (1000.0 * dy / dt) + 0.7 * map->velocity_y;
 
     map->button_motion_time = event->time;
     map->button_press_x = event->x;
     map->button_press_y = event->y;
 
-    do_callback(map);
-    hildon_pannable_map_redraw(map);
+    schedule_frame(map);
   }
 
+  /* ask for the next motion event now that this one is consumed */
+  gdk_event_request_motions(event);
+
   return FALSE;
 }
 
@@ -671,26 +2682,36 @@ hildon_pannable_map_new(float step, gboolean interactive, gboolean border,
   if (!map)
     return NULL;
 
-  map->dest_y = 0.0;
+  map->velocity_y = 0.0;
 
   if (border)
     map->line_width = 2;
 
-  map->dest_x = 0.0;
+  map->velocity_x = 0.0;
   map->zoom_factor = ZOOM_NOR;
+  _level_ref(ZOOM_NOR);
   map->scale = 1.0;
   map->interactive = interactive;
   map->transparent = transparent;
-  map->step = step;
+  /* @step used to divide the velocity every 40ms */
+  map->friction = logf(MAX(step, 1.01)) * KINETIC_FACTOR_RATE;
   map->motion_timeout_id = 0;
   map->stop_timeout_id = 0;
-  map->width = 750.0;
-  map->height = 459.5;
+  map->pos_x = _fixed_from_fraction(0.5);
+  map->pos_y = _fixed_from_fraction(0.5);
   map->canvas = gtk_drawing_area_new();
 
   g_assert(NULL != map->canvas);
 
-  gtk_widget_add_events(GTK_WIDGET(map->canvas), 0x8304);
+  maps = g_slist_prepend(maps, map);
+  map->city_index = hildon_time_zone_city_index_ref();
+
+  gtk_widget_add_events(GTK_WIDGET(map->canvas),
+                        GDK_POINTER_MOTION_MASK |
+                        GDK_POINTER_MOTION_HINT_MASK |
+                        GDK_BUTTON_PRESS_MASK |
+                        GDK_BUTTON_RELEASE_MASK |
+                        GDK_STRUCTURE_MASK);
 
   g_signal_connect(G_OBJECT(map->canvas), "expose_event",
                    G_CALLBACK(_canvas_expose_cb), map);
@@ -720,26 +2741,108 @@ hildon_pannable_map_set_city(HildonPannableMap *map, const Cityinfo *city)
 
     map->city = cityinfo_clone(city);
 
-    map->width = cityinfo_get_xpos(map->city) * -1500.0;
-    map->height = cityinfo_get_ypos(map->city) * -919.0;
+    map->pos_x = _fixed_from_fraction(cityinfo_get_xpos(map->city));
+    map->pos_y = _fixed_from_fraction(cityinfo_get_ypos(map->city));
+
+    hildon_pannable_map_scroll(map);
+  }
+}
+
+void
+hildon_pannable_map_set_show_cities(HildonPannableMap *map, gboolean show)
+{
+  if (map && map->show_cities != !!show)
+  {
+    map->show_cities = !!show;
+    hildon_pannable_map_redraw(map);
+  }
+}
+
+void
+hildon_pannable_map_set_highlight_zone(HildonPannableMap *map,
+                                       gboolean highlight)
+{
+  if (!map || map->highlight_zone == !!highlight)
+    return;
+
+  map->highlight_zone = !!highlight;
+
+  if (highlight)
+  {
+    map->zone = -1;
+    _ensure_zone_map();
+    _update_zone(map);
+    return;
+  }
+
+  if (map->zone_mask)
+  {
+    cairo_surface_destroy(map->zone_mask);
+    map->zone_mask = NULL;
+  }
+
+  _release_zone_map();
+  hildon_pannable_map_redraw(map);
+}
+
+void
+hildon_pannable_map_set_show_daylight(HildonPannableMap *map, gboolean show)
+{
+  if (!map || map->show_daylight == !!show)
+    return;
+
+  map->show_daylight = !!show;
+  map->daylight_time = 0;
+  _drop_daylight_masks(map);
 
+  if (show)
+    _update_daylight(map);
+  else
     hildon_pannable_map_redraw(map);
+}
+
+/* Shows the daylight at @time instead of now, 0 goes back to the clock */
+void
+hildon_pannable_map_set_daylight_time(HildonPannableMap *map, time_t time)
+{
+  if (map)
+  {
+    map->daylight_preview = time;
+    _update_daylight(map);
   }
 }
 
+/* To be called on every minute tick */
+void
+hildon_pannable_map_update_daylight(HildonPannableMap *map)
+{
+  if (map)
+    _update_daylight(map);
+}
+
 void
 hildon_pannable_map_clear_cache()
 {
-  if (maps_images[ZOOM_HALF])
+  int i;
+
+  for (i = 0; i < ZOOM_LAST; i++)
   {
-    g_object_unref(maps_images[ZOOM_HALF]);
-    maps_images[ZOOM_HALF] = NULL;
+    if (!map_levels[i].users)
+      _evict_level(&map_levels[i]);
   }
 
-  if (maps_images[ZOOM_DOUBLE])
+  _free_city_labels();
+  _drop_tiles();
+  hildon_time_zone_tiled_map_unref(tiled_map);
+  tiled_map = NULL;
+  tiled_map_checked = FALSE;
+  hildon_time_zone_map_cache_release();
+
+  if (cross_surface)
   {
-    g_object_unref(maps_images[ZOOM_DOUBLE]);
-    maps_images[ZOOM_DOUBLE] = NULL;
+    cairo_surface_destroy(cross_surface);
+    cross_surface = NULL;
+    cross_visual = NULL;
   }
 }
 
@@ -750,6 +2853,8 @@ hildon_pannable_map_free(HildonPannableMap *map)
     return;
 
   stop_motion_timer(map);
+  _remove_sources(map);
+  maps = g_slist_remove(maps, map);
 
   if (map->region)
   {
@@ -757,11 +2862,23 @@ hildon_pannable_map_free(HildonPannableMap *map)
     map->region = NULL;
   }
 
+  if (map->city_overlay)
+    cairo_surface_destroy(map->city_overlay);
+
+  if (map->zone_mask)
+    cairo_surface_destroy(map->zone_mask);
+
+  _drop_daylight_masks(map);
+  _release_zone_map();
   gtk_widget_hide_all(map->canvas);
   gtk_widget_destroy(map->canvas);
   cityinfo_free(map->city);
+  hildon_time_zone_city_index_unref(map->city_index);
+  _level_unref(_level_source(map->zoom_factor));
 
-  hildon_pannable_map_clear_cache();
+  /* the cities may be freed with the index now */
+  if (!maps)
+    _free_city_labels();
 
   g_free(map);
 }
@@ -0,0 +1,751 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "hildon-time-zone-search-index.h"
+
+/* Candidates are looked up one by one in posting lists this many times
+ * longer, merged otherwise */
+#define SEARCH_INDEX_GALLOP_RATIO 16
+
+/* The longest text matched with errors, one bit per byte */
+#define SEARCH_INDEX_MAX_FUZZY 64
+
+#define TRIGRAM(p) \
+  (((guint32)(guchar)(p)[0] << 16) | ((guint32)(guchar)(p)[1] << 8) | \
+   (guint32)(guchar)(p)[2])
+
+/* The posting list of trigram i is postings[starts[i]] up to
+ * postings[starts[i + 1]] */
+struct _HildonTimeZoneSearchIndex
+{
+  gint n_rows;
+  gchar *keys;
+  guint32 *key_offsets;
+  gint n_trigrams;
+  guint32 *trigrams;
+  guint32 *starts;
+  guint32 *postings;
+};
+
+/* @peq has a bit set for each position of @text holding that byte */
+typedef struct
+{
+  const gchar *text;
+  gsize len;
+  gint max_errors;
+  guint64 peq[256];
+} SearchPattern;
+
+/* Lower @rank is better, see _rank() */
+typedef struct
+{
+  guint32 row;
+  guint32 rank;
+} SearchMatch;
+
+/* @matches is NULL while @text is empty and all rows match, else it holds
+ * the matches in row order and @ranked the best of them */
+struct _HildonTimeZoneSearchFilter
+{
+  HildonTimeZoneSearchIndex *index;
+  gchar *text;
+  gint max_errors;
+  GArray *matches;
+  GArray *ranked;
+};
+
+static int
+_compare_guint64(const void *a, const void *b)
+{
+  guint64 x = *(const guint64 *)a;
+  guint64 y = *(const guint64 *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+static int
+_compare_guint32(const void *a, const void *b)
+{
+  guint32 x = *(const guint32 *)a;
+  guint32 y = *(const guint32 *)b;
+
+  return x < y ? -1 : x > y;
+}
+
+static const gchar *
+_get_key(HildonTimeZoneSearchIndex *index, guint32 row)
+{
+  return index->keys + index->key_offsets[row];
+}
+
+/* Spells a letter in ASCII if it has an obvious spelling, like ø or ß, and
+ * keeps it otherwise, so other scripts still match themselves */
+static void
+_append_transliterated(GString *s, gunichar c)
+{
+  gchar utf8[7];
+  gint len = g_unichar_to_utf8(c, utf8);
+  gchar *ascii;
+
+  utf8[len] = 0;
+  ascii = g_str_to_ascii(utf8, "C");
+
+  if (*ascii && !strchr(ascii, '?'))
+    g_string_append(s, ascii);
+  else
+    g_string_append_len(s, utf8, len);
+
+  g_free(ascii);
+}
+
+gchar *
+hildon_time_zone_search_index_normalize(const gchar *text)
+{
+  gchar *folded = g_utf8_casefold(text, -1);
+  gchar *decomposed = g_utf8_normalize(folded, -1, G_NORMALIZE_ALL);
+  const gchar *p;
+  GString *s;
+
+  if (!decomposed)
+    return folded;
+
+  g_free(folded);
+  s = g_string_sized_new(strlen(decomposed));
+
+  /* accents are combining marks after the decomposition */
+  for (p = decomposed; *p; p = g_utf8_next_char(p))
+  {
+    gunichar c = g_utf8_get_char(p);
+
+    if (c < 0x80)
+      g_string_append_c(s, c);
+    else if (!g_unichar_ismark(c))
+      _append_transliterated(s, c);
+  }
+
+  g_free(decomposed);
+
+  return g_string_free(s, FALSE);
+}
+
+/* The name and the country, a query containing the separator cannot be typed
+ * in a single line entry */
+static void
+_append_key(GString *keys, const gchar *name, const gchar *country)
+{
+  gchar *s;
+
+  if (name)
+  {
+    s = hildon_time_zone_search_index_normalize(name);
+    g_string_append(keys, s);
+    g_free(s);
+  }
+
+  g_string_append_c(keys, '\n');
+
+  if (country)
+  {
+    s = hildon_time_zone_search_index_normalize(country);
+    g_string_append(keys, s);
+    g_free(s);
+  }
+
+  g_string_append_c(keys, '\0');
+}
+
+/* Builds the index over the keys of @n_rows rows, one after the other in
+ * @keys. Takes ownership of @keys. */
+static HildonTimeZoneSearchIndex *
+_index_new(gchar *keys, gint n_rows)
+{
+  HildonTimeZoneSearchIndex *index = g_new0(HildonTimeZoneSearchIndex, 1);
+  const gchar *key = keys;
+  guint64 *pairs;
+  gsize n_pairs = 0;
+  gsize n;
+  gsize i;
+  gint row;
+
+  index->n_rows = n_rows;
+  index->keys = keys;
+  index->key_offsets = g_new(guint32, MAX(index->n_rows, 1));
+
+  for (row = 0; row < index->n_rows; row++)
+  {
+    gsize len = strlen(key);
+
+    index->key_offsets[row] = key - keys;
+    key += len + 1;
+
+    if (len >= 3)
+      n_pairs += len - 2;
+  }
+
+  /* (trigram, row) pairs, sorted they are the posting lists */
+  pairs = g_new(guint64, MAX(n_pairs, 1));
+  n = 0;
+
+  for (row = 0; row < index->n_rows; row++)
+  {
+    const gchar *p = _get_key(index, row);
+
+    for (; p[0] && p[1] && p[2]; p++)
+      pairs[n++] = ((guint64)TRIGRAM(p) << 32) | (guint32)row;
+  }
+
+  qsort(pairs, n, sizeof(guint64), _compare_guint64);
+
+  index->trigrams = g_new(guint32, MAX(n, 1));
+  index->starts = g_new(guint32, n + 1);
+  index->postings = g_new(guint32, MAX(n, 1));
+  n_pairs = 0;
+
+  for (i = 0; i < n; i++)
+  {
+    guint32 trigram = pairs[i] >> 32;
+
+    /* a trigram repeated in one key */
+    if (i && pairs[i] == pairs[i - 1])
+      continue;
+
+    if (!index->n_trigrams ||
+        index->trigrams[index->n_trigrams - 1] != trigram)
+    {
+      index->trigrams[index->n_trigrams] = trigram;
+      index->starts[index->n_trigrams] = n_pairs;
+      index->n_trigrams++;
+    }
+
+    index->postings[n_pairs++] = (guint32)pairs[i];
+  }
+
+  index->starts[index->n_trigrams] = n_pairs;
+  g_free(pairs);
+
+  return index;
+}
+
+HildonTimeZoneSearchIndex *
+hildon_time_zone_search_index_new(Cityinfo **cities)
+{
+  GString *keys = g_string_new(NULL);
+  gint n_rows;
+
+  for (n_rows = 0; cities && cities[n_rows]; n_rows++)
+  {
+    _append_key(keys, cityinfo_get_name(cities[n_rows]),
+                cityinfo_get_country(cities[n_rows]));
+  }
+
+  return _index_new(g_string_free(keys, FALSE), n_rows);
+}
+
+void
+hildon_time_zone_search_index_free(HildonTimeZoneSearchIndex *index)
+{
+  if (!index)
+    return;
+
+  g_free(index->keys);
+  g_free(index->key_offsets);
+  g_free(index->trigrams);
+  g_free(index->starts);
+  g_free(index->postings);
+  g_free(index);
+}
+
+static gboolean
+_get_postings(HildonTimeZoneSearchIndex *index, const gchar *p,
+              const guint32 **postings, guint *n_postings)
+{
+  guint32 trigram = TRIGRAM(p);
+  const guint32 *found = bsearch(&trigram, index->trigrams, index->n_trigrams,
+                                 sizeof(guint32), _compare_guint32);
+  gsize i;
+
+  if (!found)
+    return FALSE;
+
+  i = found - index->trigrams;
+  *postings = index->postings + index->starts[i];
+  *n_postings = index->starts[i + 1] - index->starts[i];
+
+  return TRUE;
+}
+
+/* Keeps the rows of @rows that are also in @postings */
+static void
+_intersect(GArray *rows, const guint32 *postings, guint n_postings)
+{
+  guint32 *r = (guint32 *)rows->data;
+  guint n = 0;
+  guint i;
+  guint j = 0;
+
+  if (n_postings > SEARCH_INDEX_GALLOP_RATIO * rows->len)
+  {
+    for (i = 0; i < rows->len; i++)
+    {
+      if (bsearch(&r[i], postings, n_postings, sizeof(guint32),
+                  _compare_guint32))
+      {
+        r[n++] = r[i];
+      }
+    }
+  }
+  else
+  {
+    for (i = 0; i < rows->len && j < n_postings; )
+    {
+      if (r[i] < postings[j])
+        i++;
+      else if (r[i] > postings[j])
+        j++;
+      else
+      {
+        r[n++] = r[i];
+        i++;
+        j++;
+      }
+    }
+  }
+
+  g_array_set_size(rows, n);
+}
+
+/* Errors allowed for a text of @len bytes, a typo every few letters */
+static gint
+_max_errors(gsize len)
+{
+  if (len < 4 || len > SEARCH_INDEX_MAX_FUZZY)
+    return 0;
+
+  return len < 8 ? 1 : 2;
+}
+
+static void
+_pattern_init(SearchPattern *pattern, const gchar *text)
+{
+  gsize i;
+
+  pattern->text = text;
+  pattern->len = strlen(text);
+  pattern->max_errors = _max_errors(pattern->len);
+  memset(pattern->peq, 0, sizeof(pattern->peq));
+
+  if (pattern->max_errors)
+  {
+    for (i = 0; i < pattern->len; i++)
+      pattern->peq[(guchar)text[i]] |= G_GUINT64_CONSTANT(1) << i;
+  }
+}
+
+/* The fewest edits turning the pattern into a substring of @key, after
+ * Myers' bit-parallel algorithm: column j of the dynamic programming matrix
+ * is kept as the bit vectors of its vertical deltas. @end is set to where the
+ * best substring ends. */
+static gint
+_edit_distance(const SearchPattern *pattern, const gchar *key, gint *end)
+{
+  guint64 high = G_GUINT64_CONSTANT(1) << (pattern->len - 1);
+  guint64 pv = ~G_GUINT64_CONSTANT(0);
+  guint64 mv = 0;
+  gint score = pattern->len;
+  gint best = pattern->len;
+  gint i;
+
+  *end = 0;
+
+  for (i = 0; key[i]; i++)
+  {
+    guint64 eq = pattern->peq[(guchar)key[i]];
+    guint64 xv = eq | mv;
+    guint64 xh = (((eq & pv) + pv) ^ pv) | eq;
+    guint64 ph = mv | ~(xh | pv);
+    guint64 mh = pv & xh;
+
+    if (ph & high)
+      score++;
+    else if (mh & high)
+      score--;
+
+    /* the first row stays 0, a match may start anywhere */
+    ph <<= 1;
+    mh <<= 1;
+    pv = mh | ~(xv | ph);
+    mv = ph & xv;
+
+    if (score < best)
+    {
+      best = score;
+      *end = i;
+    }
+  }
+
+  return best;
+}
+
+/* Fewer errors first, then matches at the start of the name, at the start of
+ * a word of it, elsewhere in it and in the country. Shorter names, being
+ * closer to the text, go first among those. */
+static guint32
+_rank(const gchar *key, gint errors, gint start)
+{
+  const gchar *country = strchr(key, '\n');
+  gint name_len = country ? country - key : (gint)strlen(key);
+  guint32 where;
+
+  if (start >= name_len)
+    where = 3;
+  else if (start == 0)
+    where = 0;
+  else if (g_ascii_isspace(key[start - 1]) || key[start - 1] == '-')
+    where = 1;
+  else
+    where = 2;
+
+  return ((guint32)errors << 24) | (where << 16) | MIN(name_len, 0xffff);
+}
+
+static gboolean
+_match(HildonTimeZoneSearchIndex *index, const SearchPattern *pattern,
+       guint32 row, SearchMatch *match)
+{
+  const gchar *key = _get_key(index, row);
+  gint errors;
+  gint end;
+
+  if (!pattern->max_errors)
+  {
+    const gchar *found = strstr(key, pattern->text);
+
+    if (!found)
+      return FALSE;
+
+    errors = 0;
+    end = found - key + pattern->len - 1;
+  }
+  else
+  {
+    errors = _edit_distance(pattern, key, &end);
+
+    if (errors > pattern->max_errors)
+      return FALSE;
+  }
+
+  match->row = row;
+  match->rank = _rank(key, errors, MAX(end + 1 - (gint)pattern->len, 0));
+
+  return TRUE;
+}
+
+/* Rows that have all trigrams of the pattern, NULL if it is too short to
+ * have any */
+static GArray *
+_exact_candidates(HildonTimeZoneSearchIndex *index,
+                  const SearchPattern *pattern)
+{
+  const guint32 *shortest = NULL;
+  guint n_shortest = 0;
+  GArray *rows;
+  gsize i;
+
+  if (pattern->len < 3)
+    return NULL;
+
+  rows = g_array_new(FALSE, FALSE, sizeof(guint32));
+
+  for (i = 0; i + 3 <= pattern->len; i++)
+  {
+    const guint32 *postings;
+    guint n_postings;
+
+    if (!_get_postings(index, pattern->text + i, &postings, &n_postings))
+      return rows;
+
+    if (!shortest || n_postings < n_shortest)
+    {
+      shortest = postings;
+      n_shortest = n_postings;
+    }
+  }
+
+  g_array_append_vals(rows, shortest, n_shortest);
+
+  for (i = 0; i + 3 <= pattern->len && rows->len; i++)
+  {
+    const guint32 *postings;
+    guint n_postings;
+
+    _get_postings(index, pattern->text + i, &postings, &n_postings);
+
+    if (postings != shortest)
+      _intersect(rows, postings, n_postings);
+  }
+
+  return rows;
+}
+
+/* A substring within k edits of a pattern of m bytes keeps at least
+ * m - 2 - 3k of its trigrams, each edit breaking at most three. Rows with
+ * fewer cannot match, NULL if that rules out none. */
+static GArray *
+_fuzzy_candidates(HildonTimeZoneSearchIndex *index,
+                  const SearchPattern *pattern)
+{
+  gint min_trigrams = (gint)pattern->len - 2 - 3 * pattern->max_errors;
+  guint8 *counts;
+  GArray *rows;
+  guint32 row;
+  gsize i;
+
+  if (min_trigrams < 1)
+    return NULL;
+
+  counts = g_new0(guint8, MAX(index->n_rows, 1));
+
+  for (i = 0; i + 3 <= pattern->len; i++)
+  {
+    const guint32 *postings;
+    guint n_postings;
+    guint j;
+
+    if (_get_postings(index, pattern->text + i, &postings, &n_postings))
+    {
+      for (j = 0; j < n_postings; j++)
+        counts[postings[j]]++;
+    }
+  }
+
+  rows = g_array_new(FALSE, FALSE, sizeof(guint32));
+
+  for (row = 0; row < (guint32)index->n_rows; row++)
+  {
+    if (counts[row] >= min_trigrams)
+      g_array_append_val(rows, row);
+  }
+
+  g_free(counts);
+
+  return rows;
+}
+
+static void
+_query(HildonTimeZoneSearchIndex *index, const SearchPattern *pattern,
+       GArray *matches)
+{
+  GArray *rows;
+  SearchMatch match;
+  guint32 row;
+  guint i;
+
+  g_array_set_size(matches, 0);
+
+  if (pattern->max_errors)
+    rows = _fuzzy_candidates(index, pattern);
+  else
+    rows = _exact_candidates(index, pattern);
+
+  if (rows)
+  {
+    for (i = 0; i < rows->len; i++)
+    {
+      if (_match(index, pattern, g_array_index(rows, guint32, i), &match))
+        g_array_append_val(matches, match);
+    }
+
+    g_array_free(rows, TRUE);
+  }
+  else
+  {
+    for (row = 0; row < (guint32)index->n_rows; row++)
+    {
+      if (_match(index, pattern, row, &match))
+        g_array_append_val(matches, match);
+    }
+  }
+}
+
+/* Matches the previous matches again, the others cannot match */
+static void
+_narrow(HildonTimeZoneSearchIndex *index, const SearchPattern *pattern,
+        GArray *matches)
+{
+  SearchMatch *m = (SearchMatch *)matches->data;
+  guint n = 0;
+  guint i;
+
+  for (i = 0; i < matches->len; i++)
+  {
+    if (_match(index, pattern, m[i].row, &m[n]))
+      n++;
+  }
+
+  g_array_set_size(matches, n);
+}
+
+#define HEAP_KEY(match) (((guint64)(match)->rank << 32) | (match)->row)
+
+static void
+_sift_down(guint64 *heap, guint n, guint i)
+{
+  for (;;)
+  {
+    guint largest = i;
+    guint child = 2 * i + 1;
+    guint64 tmp;
+
+    if (child < n && heap[child] > heap[largest])
+      largest = child;
+
+    if (child + 1 < n && heap[child + 1] > heap[largest])
+      largest = child + 1;
+
+    if (largest == i)
+      return;
+
+    tmp = heap[i];
+    heap[i] = heap[largest];
+    heap[largest] = tmp;
+    i = largest;
+  }
+}
+
+/* The best @max_rows matches in order, a max-heap keeps the worst of the best
+ * so far on top */
+static void
+_rank_matches(GArray *matches, gint max_rows, GArray *ranked)
+{
+  guint k = MIN((guint)max_rows, matches->len);
+  guint64 *heap = g_new(guint64, MAX(k, 1));
+  guint i;
+
+  for (i = 0; i < k; i++)
+    heap[i] = HEAP_KEY(&g_array_index(matches, SearchMatch, i));
+
+  for (i = k / 2; i-- > 0; )
+    _sift_down(heap, k, i);
+
+  for (i = k; i < matches->len; i++)
+  {
+    guint64 key = HEAP_KEY(&g_array_index(matches, SearchMatch, i));
+
+    if (key < heap[0])
+    {
+      heap[0] = key;
+      _sift_down(heap, k, 0);
+    }
+  }
+
+  qsort(heap, k, sizeof(guint64), _compare_guint64);
+  g_array_set_size(ranked, k);
+
+  for (i = 0; i < k; i++)
+    g_array_index(ranked, guint32, i) = (guint32)heap[i];
+
+  g_free(heap);
+}
+
+HildonTimeZoneSearchFilter *
+hildon_time_zone_search_filter_new(HildonTimeZoneSearchIndex *index)
+{
+  HildonTimeZoneSearchFilter *filter;
+
+  g_return_val_if_fail(index != NULL, NULL);
+
+  filter = g_new0(HildonTimeZoneSearchFilter, 1);
+  filter->index = index;
+  filter->text = g_strdup("");
+  filter->ranked = g_array_new(FALSE, FALSE, sizeof(guint32));
+
+  return filter;
+}
+
+void
+hildon_time_zone_search_filter_free(HildonTimeZoneSearchFilter *filter)
+{
+  if (!filter)
+    return;
+
+  if (filter->matches)
+    g_array_free(filter->matches, TRUE);
+
+  g_array_free(filter->ranked, TRUE);
+  g_free(filter->text);
+  g_free(filter);
+}
+
+gboolean
+hildon_time_zone_search_filter_set_text(HildonTimeZoneSearchFilter *filter,
+                                        const gchar *text)
+{
+  SearchPattern pattern;
+  gchar *normalized;
+
+  g_return_val_if_fail(filter != NULL, FALSE);
+
+  normalized = hildon_time_zone_search_index_normalize(text ? text : "");
+  g_strstrip(normalized);
+
+  if (!strcmp(normalized, filter->text))
+  {
+    g_free(normalized);
+    return FALSE;
+  }
+
+  _pattern_init(&pattern, normalized);
+
+  if (!*normalized)
+  {
+    if (filter->matches)
+      g_array_free(filter->matches, TRUE);
+
+    filter->matches = NULL;
+  }
+  else if (filter->matches && strstr(normalized, filter->text) &&
+           pattern.max_errors <= filter->max_errors)
+  {
+    /* typing on, whatever matches now matched before with as many errors */
+    _narrow(filter->index, &pattern, filter->matches);
+  }
+  else
+  {
+    if (!filter->matches)
+      filter->matches = g_array_new(FALSE, FALSE, sizeof(SearchMatch));
+
+    _query(filter->index, &pattern, filter->matches);
+  }
+
+  g_free(filter->text);
+  filter->text = normalized;
+  filter->max_errors = pattern.max_errors;
+  g_array_set_size(filter->ranked, 0);
+
+  return TRUE;
+}
+
+gboolean
+hildon_time_zone_search_filter_matches_all(HildonTimeZoneSearchFilter *filter)
+{
+  g_return_val_if_fail(filter != NULL, TRUE);
+
+  return filter->matches == NULL;
+}
+
+const guint32 *
+hildon_time_zone_search_filter_get_rows(HildonTimeZoneSearchFilter *filter,
+                                        gint max_rows, gint *n_rows)
+{
+  *n_rows = 0;
+
+  g_return_val_if_fail(filter != NULL, NULL);
+  g_return_val_if_fail(filter->matches != NULL, NULL);
+
+  if (filter->ranked->len < MIN((guint)max_rows, filter->matches->len))
+    _rank_matches(filter->matches, max_rows, filter->ranked);
+
+  *n_rows = MIN((guint)max_rows, filter->ranked->len);
+
+  return (const guint32 *)filter->ranked->data;
+}
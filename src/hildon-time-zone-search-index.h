@@ -0,0 +1,119 @@
+#ifndef HILDON_TIME_ZONE_SEARCH_INDEX_H
+#define HILDON_TIME_ZONE_SEARCH_INDEX_H
+
+#include <glib.h>
+#include <cityinfo.h>
+
+G_BEGIN_DECLS
+
+typedef struct _HildonTimeZoneSearchIndex HildonTimeZoneSearchIndex;
+typedef struct _HildonTimeZoneSearchFilter HildonTimeZoneSearchFilter;
+
+/**
+ * @brief Builds a substring index over the city and country names.
+ *
+ * Names are normalized with #hildon_time_zone_search_index_normalize() and
+ * every three byte sequence of them is indexed, so a query of three bytes or
+ * more only looks at the cities that have all of its trigrams.
+ *
+ * @param cities A NULL terminated array of cities, row i of the index is
+ *               cities[i]. The array is not kept.
+ *
+ * @returns A new #HildonTimeZoneSearchIndex.
+ */
+HildonTimeZoneSearchIndex *
+hildon_time_zone_search_index_new(Cityinfo **cities);
+
+/**
+ * @brief Frees an index.
+ *
+ * @param index A #HildonTimeZoneSearchIndex.
+ */
+void
+hildon_time_zone_search_index_free(HildonTimeZoneSearchIndex *index);
+
+/**
+ * @brief Normalizes text for matching.
+ *
+ * The text is case folded and decomposed, accents are dropped and letters
+ * with an obvious ASCII spelling are spelled that way, so "São Paulo" and
+ * "Straße" become "sao paulo" and "strasse". Other scripts are kept.
+ *
+ * @param text UTF-8 text.
+ *
+ * @returns A newly allocated string.
+ */
+gchar *
+hildon_time_zone_search_index_normalize(const gchar *text);
+
+/**
+ * @brief Creates a filter narrowing the rows of an index as the text is
+ *        typed.
+ *
+ * @param index The index to search. It must outlive the filter.
+ *
+ * @returns A new #HildonTimeZoneSearchFilter matching all rows.
+ */
+HildonTimeZoneSearchFilter *
+hildon_time_zone_search_filter_new(HildonTimeZoneSearchIndex *index);
+
+/**
+ * @brief Frees a filter.
+ *
+ * @param filter A #HildonTimeZoneSearchFilter.
+ */
+void
+hildon_time_zone_search_filter_free(HildonTimeZoneSearchFilter *filter);
+
+/**
+ * @brief Sets the text the rows must contain.
+ *
+ * Texts of four bytes or more may match with a typo, of eight or more with
+ * two. When the new text contains the previous one and allows no more typos
+ * only the previous matches are checked again, otherwise the index is
+ * queried.
+ *
+ * @param filter A #HildonTimeZoneSearchFilter.
+ * @param text UTF-8 text, empty or NULL to match all rows.
+ *
+ * @returns TRUE if the matching rows may have changed.
+ */
+gboolean
+hildon_time_zone_search_filter_set_text(HildonTimeZoneSearchFilter *filter,
+                                        const gchar *text);
+
+/**
+ * @brief Tells whether the filter lets all rows through.
+ *
+ * @param filter A #HildonTimeZoneSearchFilter.
+ *
+ * @returns TRUE while the text is empty.
+ */
+gboolean
+hildon_time_zone_search_filter_matches_all(HildonTimeZoneSearchFilter *filter);
+
+/**
+ * @brief Returns the best matching rows.
+ *
+ * Rows matching with fewer typos come first, then the ones matching at the
+ * start of the city name, of a word of it, elsewhere in it and in the
+ * country. Shorter names go first among those.
+ *
+ * Only meaningful when the filter does not match all rows, see
+ * #hildon_time_zone_search_filter_matches_all().
+ *
+ * @param filter A #HildonTimeZoneSearchFilter.
+ * @param max_rows The most rows to return.
+ * @param n_rows Return location for the number of rows, 0 if nothing
+ *               matches.
+ *
+ * @returns The row numbers, best first, owned by the filter and valid until
+ *          the text is set again.
+ */
+const guint32 *
+hildon_time_zone_search_filter_get_rows(HildonTimeZoneSearchFilter *filter,
+                                        gint max_rows, gint *n_rows);
+
+G_END_DECLS
+
+#endif /* HILDON_TIME_ZONE_SEARCH_INDEX_H */
@@ -18,11 +18,12 @@
  */
 
 #include <libintl.h>
-#include <time.h>
-
-#include <clockd/libtime.h>
 
 #include "hildon-time-zone-search.h"
+#include "hildon-time-zone-city-model.h"
+
+/* The best matches shown while a text is typed */
+#define SEARCH_MAX_ROWS 500
 
 struct _HildonTimeZoneSearch
 {
@@ -31,8 +32,9 @@ struct _HildonTimeZoneSearch
   GtkWidget *dialog;
   GtkWidget *button;
   GtkWidget *selector;
+  GtkWidget *entry;
   GtkTreeModel *tree_model;
-  Cityinfo **cities;
+  HildonTimeZoneSearchFilter *filter;
   gboolean changed;
 };
 
@@ -49,7 +51,10 @@ _selector_value_changed(HildonPickerButton *widget,
   if (hildon_touch_selector_get_selected(
         HILDON_TOUCH_SELECTOR(search->selector), 0, &iter))
   {
-    gtk_tree_model_get(search->tree_model, &iter, 1, &city, -1);
+    /* the rows shown may be a subset of tree_model */
+    gtk_tree_model_get(hildon_touch_selector_get_model(
+                         HILDON_TOUCH_SELECTOR(search->selector), 0), &iter,
+                       HILDON_TIME_ZONE_CITY_MODEL_COLUMN_CITY, &city, -1);
 
     if (city)
       cityinfo_free(search->city);
@@ -61,6 +66,63 @@ _selector_value_changed(HildonPickerButton *widget,
   gtk_widget_hide_all(search->dialog);
 }
 
+static void
+_entry_changed(GtkEditable *editable, gpointer user_data)
+{
+  HildonTimeZoneSearch *search = user_data;
+  GtkTreeModel *model;
+
+  if (!hildon_time_zone_search_filter_set_text(
+        search->filter, gtk_entry_get_text(GTK_ENTRY(editable))))
+  {
+    return;
+  }
+
+  /* a new model is cheaper than removing the rows that no longer match one by
+   * one */
+  if (hildon_time_zone_search_filter_matches_all(search->filter))
+    model = g_object_ref(search->tree_model);
+  else
+  {
+    gint n_rows;
+    const guint32 *rows = hildon_time_zone_search_filter_get_rows(
+          search->filter, SEARCH_MAX_ROWS, &n_rows);
+
+    model = GTK_TREE_MODEL(hildon_time_zone_city_model_new_subset(
+                             HILDON_TIME_ZONE_CITY_MODEL(search->tree_model),
+                             rows, n_rows));
+  }
+
+  hildon_touch_selector_set_model(HILDON_TOUCH_SELECTOR(search->selector), 0,
+                                  model);
+  g_object_unref(model);
+}
+
+/* All labels are one line high, so the tree views of the selector only need
+ * to measure the first row, not format every label when the model is set */
+static void
+_set_fixed_height_mode(GtkWidget *widget, gpointer user_data)
+{
+  if (GTK_IS_TREE_VIEW(widget))
+  {
+    GList *columns = gtk_tree_view_get_columns(GTK_TREE_VIEW(widget));
+    GList *l;
+
+    /* fixed height mode needs fixed size columns, the expanding one still
+     * takes the whole width */
+    for (l = columns; l; l = l->next)
+    {
+      gtk_tree_view_column_set_sizing(l->data, GTK_TREE_VIEW_COLUMN_FIXED);
+      gtk_tree_view_column_set_expand(l->data, TRUE);
+    }
+
+    g_list_free(columns);
+    gtk_tree_view_set_fixed_height_mode(GTK_TREE_VIEW(widget), TRUE);
+  }
+  else if (GTK_IS_CONTAINER(widget))
+    gtk_container_forall(GTK_CONTAINER(widget), _set_fixed_height_mode, NULL);
+}
+
 HildonTimeZoneSearch *
 hildon_time_zone_search_new(GtkWidget *parent)
 {
@@ -68,9 +130,6 @@ hildon_time_zone_search_new(GtkWidget *parent)
   HildonTouchSelectorColumn *col;
   HildonTimeZoneSearch *search;
   GtkWidget *vbox;
-  GtkListStore *list_store;
-  GtkTreeIter iter;
-  Cityinfo **c;
 
   g_assert(NULL != parent);
 
@@ -82,7 +141,6 @@ hildon_time_zone_search_new(GtkWidget *parent)
   search->changed = FALSE;
   search->parent = parent;
   search->city = NULL;
-  search->cities = cityinfo_get_all();
 
   search->dialog = gtk_dialog_new_with_buttons(
         dgettext("osso-clock", "cloc_ti_search_city_title"),
@@ -96,87 +154,35 @@ hildon_time_zone_search_new(GtkWidget *parent)
   search->button = hildon_picker_button_new(HILDON_SIZE_AUTO_WIDTH,
                                             HILDON_BUTTON_ARRANGEMENT_VERTICAL);
   search->selector = GTK_WIDGET(hildon_touch_selector_new());
+  search->entry = hildon_entry_new(HILDON_SIZE_AUTO);
+  gtk_box_pack_start(GTK_BOX(vbox), search->entry, FALSE, FALSE, 0);
   gtk_box_pack_start(GTK_BOX(vbox), search->selector, TRUE, TRUE, 0);
 
-  search->tree_model = GTK_TREE_MODEL(
-        gtk_list_store_new(4, G_TYPE_STRING, G_TYPE_POINTER, G_TYPE_INT,
-                           G_TYPE_INT));
-  list_store = GTK_LIST_STORE(search->tree_model);
-
-  for (c = search->cities; *c; c++)
-  {
-    Cityinfo *city = *c;
-    int utc_offset = time_get_utc_offset(cityinfo_get_zone(city));
-    int utc_offset_m = utc_offset % 3600;
-    gchar *country = cityinfo_get_country(city);
-    gchar *name = cityinfo_get_name(city);
-    gchar *tz;
-    gchar *tmp;
-
-    gtk_list_store_append(list_store, &iter);
-
-
-    if (utc_offset_m)
-    {
-      const char *format =
-          dgettext("osso-clock", "cloc_fi_timezonefull_minutes");
-
-      tz = g_strdup_printf(
-            format, utc_offset / -3600,
-            utc_offset_m <= 59 ? utc_offset_m / -60 : utc_offset_m / 60, name,
-            country);
-    }
-    else
-    {
-      const char *format = dgettext("osso-clock", "cloc_fi_timezonefull");
-
-      tz = g_strdup_printf(format, utc_offset / -3600, name, country);
-    }
-
-    gtk_list_store_set(list_store, &iter, 0, tz, 1, city, 2, 5, -1);
-
-    tmp = g_utf8_casefold(city->name, -1);
-    g_free(city->name);
-    city->name = tmp;
-
-    tmp = g_utf8_casefold(city->country, -1);
-    g_free(city->country);
-    city->country = tmp;
-
-    g_free(city->locale);
-    city->locale = g_utf8_casefold(tz, -1);
-
-    g_free(tz);
-  }
-
-  if (gtk_tree_model_get_iter_first(GTK_TREE_MODEL(list_store), &iter))
-  {
-    int i = 0;
-
-    do
-    {
-      gtk_list_store_set(list_store, &iter,
-                         3, ++i,
-                         2, 4,
-                         -1);
-    }
-    while (gtk_tree_model_iter_next(GTK_TREE_MODEL(list_store), &iter));
-  }
+  /* rows are read straight from the city array, labels are only built for
+   * the rows shown and kept for the next dialog */
+  search->tree_model = GTK_TREE_MODEL(hildon_time_zone_city_model_get_shared());
+  search->filter = hildon_time_zone_search_filter_new(
+        hildon_time_zone_city_model_get_search_index(
+          HILDON_TIME_ZONE_CITY_MODEL(search->tree_model)));
 
   cr = gtk_cell_renderer_text_new();
   gtk_cell_renderer_set_fixed_size(cr, 355, -1);
   col = hildon_touch_selector_append_column(
         HILDON_TOUCH_SELECTOR(search->selector), search->tree_model,
-        cr, "text", 0,
+        cr, "text", HILDON_TIME_ZONE_CITY_MODEL_COLUMN_LABEL,
         NULL);
 
-  hildon_touch_selector_column_set_text_column(col, 0);
+  hildon_touch_selector_column_set_text_column(
+        col, HILDON_TIME_ZONE_CITY_MODEL_COLUMN_LABEL);
+  _set_fixed_height_mode(search->selector, NULL);
 
   hildon_picker_button_set_selector(HILDON_PICKER_BUTTON(search->button),
                                     HILDON_TOUCH_SELECTOR(search->selector));
 
   g_signal_connect(G_OBJECT(search->button), "value-changed",
                    G_CALLBACK(_selector_value_changed), search);
+  g_signal_connect(G_OBJECT(search->entry), "changed",
+                   G_CALLBACK(_entry_changed), search);
 
   gtk_box_pack_start(
         GTK_BOX(GTK_DIALOG(search->dialog)->vbox), vbox, TRUE, TRUE, 0);
@@ -190,40 +196,31 @@ hildon_time_zone_search_run(HildonTimeZoneSearch *tz_search)
 {
   if (tz_search->city)
   {
-    GtkTreeIter iter;
-    Cityinfo *city = NULL;
+    HildonTimeZoneCityModel *model =
+        HILDON_TIME_ZONE_CITY_MODEL(tz_search->tree_model);
+    gint n_cities = hildon_time_zone_city_model_get_n_cities(model);
     gint id = cityinfo_get_id(tz_search->city);
+    GtkTreeIter iter;
+    gint index;
 
-    if (id != -1)
+    for (index = 0; id != -1 && index < n_cities; index++)
     {
-      if (gtk_tree_model_get_iter_first(tz_search->tree_model, &iter))
-      {
-        gint index = 0;
-
-        gtk_tree_model_get(tz_search->tree_model, &iter,
-                           1, &city,
-                           -1);
-
-        while (id != cityinfo_get_id(city))
-        {
-          if (!gtk_tree_model_iter_next(tz_search->tree_model, &iter))
-            goto out;
-
-          index++;
-          gtk_tree_model_get(tz_search->tree_model, &iter,
-                             1, &city,
-                             -1);
-        }
+      const Cityinfo *city =
+          hildon_time_zone_city_model_get_city(model, index);
 
+      if (id == cityinfo_get_id(city))
+      {
+        gtk_tree_model_iter_nth_child(tz_search->tree_model, &iter, NULL,
+                                      index);
         hildon_touch_selector_select_iter(
               HILDON_TOUCH_SELECTOR(tz_search->selector), 0, &iter, TRUE);
         hildon_touch_selector_set_active(
               HILDON_TOUCH_SELECTOR(tz_search->selector), 0, index);
+        break;
       }
     }
   }
 
-out:
   gtk_widget_show_all(tz_search->dialog);
   gtk_dialog_run(GTK_DIALOG(tz_search->dialog));
 
@@ -241,11 +238,18 @@ hildon_time_zone_search_free(HildonTimeZoneSearch *tz_search)
 {
   gtk_widget_hide_all(tz_search->dialog);
   gtk_widget_destroy(tz_search->dialog);
+  hildon_time_zone_search_filter_free(tz_search->filter);
+  g_object_unref(tz_search->tree_model);
   cityinfo_free(tz_search->city);
-  cityinfo_free_all(tz_search->cities);
   g_free(tz_search);
 }
 
+void
+hildon_time_zone_search_clear_cache()
+{
+  hildon_time_zone_city_model_release_shared();
+}
+
 void
 hildon_time_zone_search_set_city(HildonTimeZoneSearch *tz_search,
                                  const Cityinfo *city)
@@ -0,0 +1,299 @@
+#include <string.h>
+
+#include "hildon-time-zone-tiled-map.h"
+
+#define TILED_MAP_MAGIC "HTZTILE"
+#define TILED_MAP_VERSION 1
+#define TILED_MAP_MAX_LEVELS 16
+#define TILED_MAP_MAX_SIZE 65536
+
+typedef struct
+{
+  gchar magic[8];
+  guint32 version;
+  guint32 tile_size;
+  guint32 n_levels;
+  guint32 reserved;
+} TiledMapHeader;
+
+typedef struct
+{
+  guint32 width;
+  guint32 height;
+} TiledMapLevelEntry;
+
+typedef struct
+{
+  guint64 offset;
+  guint32 length;
+  guint32 reserved;
+} TiledMapTileEntry;
+
+typedef struct
+{
+  gint width;
+  gint height;
+  gint cols;
+  gint rows;
+  const TiledMapTileEntry *tiles;
+} TiledMapLevel;
+
+struct _HildonTimeZoneTiledMap
+{
+  gint ref_count;
+  GMappedFile *file;
+  gint tile_size;
+  gint n_levels;
+  TiledMapLevel levels[TILED_MAP_MAX_LEVELS];
+};
+
+/* Checks the header and the tile table and fills in the level table */
+static gboolean
+_tiled_map_parse(HildonTimeZoneTiledMap *map)
+{
+  const gchar *contents = g_mapped_file_get_contents(map->file);
+  guint64 length = g_mapped_file_get_length(map->file);
+  const TiledMapHeader *header = (const TiledMapHeader *)contents;
+  const TiledMapLevelEntry *entries;
+  guint64 table;
+  gint i;
+
+  if (length < sizeof(*header) ||
+      memcmp(header->magic, TILED_MAP_MAGIC, sizeof(header->magic)) ||
+      GUINT32_FROM_LE(header->version) != TILED_MAP_VERSION)
+  {
+    return FALSE;
+  }
+
+  map->tile_size = GUINT32_FROM_LE(header->tile_size);
+  map->n_levels = GUINT32_FROM_LE(header->n_levels);
+
+  if (map->tile_size < 1 || map->tile_size > TILED_MAP_MAX_SIZE ||
+      map->n_levels < 1 || map->n_levels > TILED_MAP_MAX_LEVELS ||
+      length < sizeof(*header) + map->n_levels * sizeof(*entries))
+  {
+    return FALSE;
+  }
+
+  entries = (const TiledMapLevelEntry *)(contents + sizeof(*header));
+  table = sizeof(*header) + map->n_levels * sizeof(*entries);
+
+  for (i = 0; i < map->n_levels; i++)
+  {
+    TiledMapLevel *level = &map->levels[i];
+    guint64 n_tiles;
+    guint64 j;
+
+    level->width = GUINT32_FROM_LE(entries[i].width);
+    level->height = GUINT32_FROM_LE(entries[i].height);
+
+    if (level->width < 1 || level->width > TILED_MAP_MAX_SIZE ||
+        level->height < 1 || level->height > TILED_MAP_MAX_SIZE)
+    {
+      return FALSE;
+    }
+
+    level->cols = (level->width + map->tile_size - 1) / map->tile_size;
+    level->rows = (level->height + map->tile_size - 1) / map->tile_size;
+    n_tiles = (guint64)level->cols * level->rows;
+
+    if (table + n_tiles * sizeof(TiledMapTileEntry) > length)
+      return FALSE;
+
+    level->tiles = (const TiledMapTileEntry *)(contents + table);
+    table += n_tiles * sizeof(TiledMapTileEntry);
+
+    for (j = 0; j < n_tiles; j++)
+    {
+      guint64 offset = GUINT64_FROM_LE(level->tiles[j].offset);
+      guint32 size = GUINT32_FROM_LE(level->tiles[j].length);
+
+      if (size && (offset > length || size > length - offset))
+        return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
+HildonTimeZoneTiledMap *
+hildon_time_zone_tiled_map_open(const gchar *filename)
+{
+  HildonTimeZoneTiledMap *map;
+  GMappedFile *file = g_mapped_file_new(filename, FALSE, NULL);
+
+  if (!file)
+    return NULL;
+
+  map = g_new0(HildonTimeZoneTiledMap, 1);
+  map->ref_count = 1;
+  map->file = file;
+
+  if (!_tiled_map_parse(map))
+  {
+    g_warning("Invalid tiled map %s", filename);
+    hildon_time_zone_tiled_map_unref(map);
+    return NULL;
+  }
+
+  return map;
+}
+
+HildonTimeZoneTiledMap *
+hildon_time_zone_tiled_map_ref(HildonTimeZoneTiledMap *map)
+{
+  g_return_val_if_fail(map != NULL, NULL);
+
+  map->ref_count++;
+
+  return map;
+}
+
+void
+hildon_time_zone_tiled_map_unref(HildonTimeZoneTiledMap *map)
+{
+  if (!map || --map->ref_count)
+    return;
+
+  g_mapped_file_unref(map->file);
+  g_free(map);
+}
+
+gint
+hildon_time_zone_tiled_map_get_tile_size(HildonTimeZoneTiledMap *map)
+{
+  g_return_val_if_fail(map != NULL, 0);
+
+  return map->tile_size;
+}
+
+gint
+hildon_time_zone_tiled_map_find_level(HildonTimeZoneTiledMap *map,
+                                      gint width, gint height)
+{
+  gint i;
+
+  g_return_val_if_fail(map != NULL, -1);
+
+  for (i = 0; i < map->n_levels; i++)
+  {
+    if (map->levels[i].width == width && map->levels[i].height == height)
+      return i;
+  }
+
+  return -1;
+}
+
+GdkPixbuf *
+hildon_time_zone_tiled_map_load_tile(HildonTimeZoneTiledMap *map, gint level,
+                                     gint col, gint row)
+{
+  const TiledMapLevel *l;
+  const TiledMapTileEntry *tile;
+  GdkPixbufLoader *loader;
+  GdkPixbuf *pixbuf = NULL;
+  guint32 length;
+  gboolean ok;
+
+  g_return_val_if_fail(map != NULL, NULL);
+  g_return_val_if_fail(level >= 0 && level < map->n_levels, NULL);
+
+  l = &map->levels[level];
+
+  if (col < 0 || col >= l->cols || row < 0 || row >= l->rows)
+    return NULL;
+
+  tile = &l->tiles[row * l->cols + col];
+  length = GUINT32_FROM_LE(tile->length);
+
+  if (!length)
+    return NULL;
+
+  /* decoding straight from the mapping, only the pages of this tile are
+   * read from disk */
+  loader = gdk_pixbuf_loader_new();
+
+  ok = gdk_pixbuf_loader_write(
+        loader, (const guchar *)g_mapped_file_get_contents(map->file) +
+        GUINT64_FROM_LE(tile->offset), length, NULL);
+
+  if (gdk_pixbuf_loader_close(loader, NULL) && ok)
+    pixbuf = gdk_pixbuf_loader_get_pixbuf(loader);
+
+  /* reject tiles not matching the level layout */
+  if (pixbuf &&
+      (gdk_pixbuf_get_width(pixbuf) !=
+       MIN(map->tile_size, l->width - col * map->tile_size) ||
+       gdk_pixbuf_get_height(pixbuf) !=
+       MIN(map->tile_size, l->height - row * map->tile_size)))
+  {
+    pixbuf = NULL;
+  }
+
+  if (pixbuf)
+    g_object_ref(pixbuf);
+
+  g_object_unref(loader);
+
+  return pixbuf;
+}
+
+static void
+_append_le32(GByteArray *data, guint32 v)
+{
+  v = GUINT32_TO_LE(v);
+  g_byte_array_append(data, (const guint8 *)&v, sizeof(v));
+}
+
+static void
+_append_le64(GByteArray *data, guint64 v)
+{
+  v = GUINT64_TO_LE(v);
+  g_byte_array_append(data, (const guint8 *)&v, sizeof(v));
+}
+
+GByteArray *
+hildon_time_zone_tiled_map_pack(gint tile_size, const gint *sizes,
+                                gint n_levels, GPtrArray *tiles)
+{
+  GByteArray *data = g_byte_array_new();
+  guint64 offset = sizeof(TiledMapHeader) +
+      n_levels * sizeof(TiledMapLevelEntry) +
+      (guint64)tiles->len * sizeof(TiledMapTileEntry);
+  guint i;
+  gint l;
+
+  g_byte_array_append(data, (const guint8 *)TILED_MAP_MAGIC,
+                      sizeof(TILED_MAP_MAGIC));
+  _append_le32(data, TILED_MAP_VERSION);
+  _append_le32(data, tile_size);
+  _append_le32(data, n_levels);
+  _append_le32(data, 0);
+
+  for (l = 0; l < n_levels; l++)
+  {
+    _append_le32(data, sizes[2 * l]);
+    _append_le32(data, sizes[2 * l + 1]);
+  }
+
+  for (i = 0; i < tiles->len; i++)
+  {
+    gsize length = g_bytes_get_size(g_ptr_array_index(tiles, i));
+
+    _append_le64(data, offset);
+    _append_le32(data, length);
+    _append_le32(data, 0);
+    offset += length;
+  }
+
+  for (i = 0; i < tiles->len; i++)
+  {
+    gsize length;
+    gconstpointer tile = g_bytes_get_data(g_ptr_array_index(tiles, i),
+                                          &length);
+
+    g_byte_array_append(data, tile, length);
+  }
+
+  return data;
+}
@@ -0,0 +1,122 @@
+#ifndef HILDON_TIME_ZONE_TILED_MAP_H
+#define HILDON_TIME_ZONE_TILED_MAP_H
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+G_BEGIN_DECLS
+
+/*
+ * A tiled world map container holds the map at several resolutions, each cut
+ * into square tiles compressed separately, typically as JPEG. All integers
+ * are little endian:
+ *
+ *   guint8  magic[8]       "HTZTILE\0"
+ *   guint32 version        1
+ *   guint32 tile_size      width and height of a full tile
+ *   guint32 n_levels
+ *   guint32 reserved
+ *   n_levels times:
+ *     guint32 width        size of the whole level
+ *     guint32 height
+ *   for each level, for each row, for each column of tiles:
+ *     guint64 offset       start of the compressed tile in the file
+ *     guint32 length       0 if the tile is missing
+ *     guint32 reserved
+ *   tile data
+ *
+ * Tiles in the last row and column are cut to the level size. The
+ * hildon-time-zone-map-pack tool writes such containers with
+ * #hildon_time_zone_tiled_map_pack().
+ */
+typedef struct _HildonTimeZoneTiledMap HildonTimeZoneTiledMap;
+
+/**
+ * @brief Maps a tiled world map container.
+ *
+ * @param filename The container file.
+ *
+ * @returns The container holding one reference, or NULL if the file is
+ *          missing or invalid. Release with
+ *          #hildon_time_zone_tiled_map_unref().
+ */
+HildonTimeZoneTiledMap *
+hildon_time_zone_tiled_map_open(const gchar *filename);
+
+/**
+ * @brief Adds a reference to a container, so tiles can be decoded from it
+ *        on another thread while its opener lets go of it.
+ *
+ * References are counted without locking, take and release them on one
+ * thread.
+ *
+ * @param map A #HildonTimeZoneTiledMap.
+ *
+ * @returns @map.
+ */
+HildonTimeZoneTiledMap *
+hildon_time_zone_tiled_map_ref(HildonTimeZoneTiledMap *map);
+
+/**
+ * @brief Releases a reference, the container is unmapped with the last one.
+ *
+ * @param map A #HildonTimeZoneTiledMap, may be NULL.
+ */
+void
+hildon_time_zone_tiled_map_unref(HildonTimeZoneTiledMap *map);
+
+/**
+ * @brief Returns the width and height of the tiles in the container.
+ *
+ * @param map A #HildonTimeZoneTiledMap.
+ *
+ * @returns The tile size.
+ */
+gint
+hildon_time_zone_tiled_map_get_tile_size(HildonTimeZoneTiledMap *map);
+
+/**
+ * @brief Finds the level of the given size.
+ *
+ * @param map A #HildonTimeZoneTiledMap.
+ * @param width Width of the level.
+ * @param height Height of the level.
+ *
+ * @returns The level index, or -1 if the container has no such level.
+ */
+gint
+hildon_time_zone_tiled_map_find_level(HildonTimeZoneTiledMap *map,
+                                      gint width, gint height);
+
+/**
+ * @brief Decodes a single tile.
+ *
+ * @param map A #HildonTimeZoneTiledMap.
+ * @param level The level index.
+ * @param col Tile column.
+ * @param row Tile row.
+ *
+ * @returns A new GdkPixbuf, or NULL if the tile is missing or broken.
+ */
+GdkPixbuf *
+hildon_time_zone_tiled_map_load_tile(HildonTimeZoneTiledMap *map, gint level,
+                                     gint col, gint row);
+
+/**
+ * @brief Lays out a container, the header, the level and tile tables and
+ *        the tile data.
+ *
+ * @param tile_size Width and height of a full tile.
+ * @param sizes Width and height of each level, one after the other.
+ * @param n_levels The number of levels.
+ * @param tiles #GBytes of the compressed tiles of all levels, level by level
+ *              and row by row. Empty ones are listed as missing.
+ *
+ * @returns The container contents. Free with g_byte_array_free().
+ */
+GByteArray *
+hildon_time_zone_tiled_map_pack(gint tile_size, const gint *sizes,
+                                gint n_levels, GPtrArray *tiles);
+
+G_END_DECLS
+
+#endif /* HILDON_TIME_ZONE_TILED_MAP_H */
@@ -0,0 +1,282 @@
+#include <libintl.h>
+#include <string.h>
+#include <time.h>
+
+#include <clockd/libtime.h>
+
+#include "hildon-time-zone-utc-offset.h"
+
+#define UTC_OFFSET_ZONEINFO_DIR "/usr/share/zoneinfo"
+
+/* How long an offset is trusted when the zone data tells no transition but
+ * does not rule them out either. Transitions happen on quarter hours in
+ * UTC. */
+#define UTC_OFFSET_RECHECK 900
+
+/* TZif header, the counts are big endian */
+#define TZIF_HEADER_SIZE 44
+#define TZIF_COUNTS 20
+
+/* @offset was read at @checked and holds until @expires */
+typedef struct
+{
+  gint offset;
+  time_t checked;
+  time_t expires;
+} UtcOffset;
+
+static GHashTable *offsets = NULL;
+
+static guint32
+_read_be32(const gchar *p)
+{
+  guint32 v;
+
+  memcpy(&v, p, sizeof(v));
+
+  return GUINT32_FROM_BE(v);
+}
+
+static gint64
+_read_be64(const gchar *p)
+{
+  guint64 v;
+
+  memcpy(&v, p, sizeof(v));
+
+  return (gint64)GUINT64_FROM_BE(v);
+}
+
+/* Size of the data block following the TZif header at @header, with
+ * transition times and leap second records of @time_size bytes. Counts are
+ * checked against the @length of the file first, so the sum cannot wrap even
+ * where gsize is 32 bits; G_MAXUINT64 if one of them is larger. */
+static guint64
+_block_size(const gchar *header, gsize time_size, gsize length)
+{
+  /* isutcnt, isstdcnt, leapcnt, timecnt, typecnt and charcnt */
+  const guint64 record_sizes[] =
+      { 1, 1, time_size + 4, time_size + 1, 6, 1 };
+  guint64 size = 0;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS(record_sizes); i++)
+  {
+    guint32 n = _read_be32(header + TZIF_COUNTS + 4 * i);
+
+    if (n > length)
+      return G_MAXUINT64;
+
+    size += n * record_sizes[i];
+  }
+
+  return size;
+}
+
+/* TRUE if the TZ string in the footer of a version 2 file at @footer has no
+ * daylight saving rule, so the last offset holds for good */
+static gboolean
+_footer_is_fixed(const gchar *footer, const gchar *end)
+{
+  const gchar *p;
+
+  if (footer >= end || *footer != '\n')
+    return FALSE;
+
+  for (p = footer + 1; p < end && *p != '\n'; p++)
+  {
+    if (*p == ',')
+      return FALSE;
+  }
+
+  return p < end && p > footer + 1;
+}
+
+/* The first transition of @zone after @now, 0 if the zone data lists none.
+ * @fixed is set if there is none and the zone data rules out later ones too.
+ * Version 2 and later files repeat the data with 64-bit times after the
+ * version 1 block and end with a TZ string for times past it, see
+ * tzfile(5). */
+static time_t
+_next_transition(const gchar *zone, time_t now, gboolean *fixed)
+{
+  const gchar *dir = g_getenv("TZDIR");
+  gchar *filename;
+  gchar *data;
+  const gchar *header;
+  const gchar *times;
+  gsize length;
+  gsize time_size = 4;
+  guint64 block_size;
+  guint32 timecnt;
+  time_t next = 0;
+  guint32 i;
+
+  *fixed = FALSE;
+
+  if (*zone == ':')
+    zone++;
+
+  filename = g_build_filename(dir ? dir : UTC_OFFSET_ZONEINFO_DIR, zone,
+                              NULL);
+
+  if (!g_file_get_contents(filename, &data, &length, NULL))
+  {
+    g_free(filename);
+    return 0;
+  }
+
+  g_free(filename);
+  header = data;
+
+  if (length < TZIF_HEADER_SIZE || memcmp(header, "TZif", 4))
+    goto out;
+
+  if (header[4] >= '2')
+  {
+    block_size = _block_size(header, 4, length);
+
+    if (length < 2 * TZIF_HEADER_SIZE ||
+        block_size > length - 2 * TZIF_HEADER_SIZE)
+    {
+      goto out;
+    }
+
+    header += TZIF_HEADER_SIZE + block_size;
+    time_size = 8;
+  }
+
+  timecnt = _read_be32(header + TZIF_COUNTS + 12);
+  times = header + TZIF_HEADER_SIZE;
+
+  /* times is at most @length into the file by now */
+  if ((guint64)timecnt * time_size > length - (gsize)(times - data))
+    goto out;
+
+  for (i = 0; i < timecnt; i++)
+  {
+    gint64 t = time_size == 8 ? _read_be64(times + 8 * i) :
+                                (gint32)_read_be32(times + 4 * i);
+
+    if (t > now)
+    {
+      next = t;
+      break;
+    }
+  }
+
+  if (!next && time_size == 8)
+  {
+    block_size = _block_size(header, 8, length);
+
+    if (block_size < length - (gsize)(times - data))
+      *fixed = _footer_is_fixed(times + block_size, data + length);
+  }
+
+out:
+  g_free(data);
+
+  return next;
+}
+
+/* The remembered offset of @zone, looked up again once expired */
+static UtcOffset *
+_lookup(const gchar *zone)
+{
+  time_t now = time(NULL);
+  UtcOffset *entry;
+
+  if (!offsets)
+    offsets = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+
+  entry = g_hash_table_lookup(offsets, zone);
+
+  if (!entry)
+  {
+    entry = g_new0(UtcOffset, 1);
+    g_hash_table_insert(offsets, g_strdup(zone), entry);
+  }
+
+  /* also when the clock was set back */
+  if (now >= entry->expires || now < entry->checked)
+  {
+    gboolean fixed;
+
+    entry->offset = time_get_utc_offset(zone);
+    entry->checked = now;
+    entry->expires = _next_transition(zone, now, &fixed);
+
+    if (fixed)
+      entry->expires = HILDON_TIME_ZONE_UTC_OFFSET_NEVER;
+    else if (!entry->expires)
+      entry->expires = now - now % UTC_OFFSET_RECHECK + UTC_OFFSET_RECHECK;
+  }
+
+  return entry;
+}
+
+gint
+hildon_time_zone_utc_offset_get(const gchar *zone)
+{
+  if (!zone)
+    return time_get_utc_offset(zone);
+
+  return _lookup(zone)->offset;
+}
+
+gchar *
+hildon_time_zone_utc_offset_format_label(const Cityinfo *city,
+                                         time_t *expires)
+{
+  const gchar *zone = cityinfo_get_zone(city);
+  gint utc_offset;
+  gint utc_offset_m;
+  gchar *country = cityinfo_get_country(city);
+  gchar *name = cityinfo_get_name(city);
+
+  if (zone)
+  {
+    UtcOffset *entry = _lookup(zone);
+
+    utc_offset = entry->offset;
+
+    if (expires)
+      *expires = entry->expires;
+  }
+  else
+  {
+    time_t now = time(NULL);
+
+    utc_offset = time_get_utc_offset(zone);
+
+    if (expires)
+      *expires = now - now % UTC_OFFSET_RECHECK + UTC_OFFSET_RECHECK;
+  }
+
+  utc_offset_m = utc_offset % 3600;
+
+  if (utc_offset_m)
+  {
+    const char *format =
+        dgettext("osso-clock", "cloc_fi_timezonefull_minutes");
+
+    return g_strdup_printf(format, utc_offset / -3600,
+                           ABS(utc_offset_m) / 60, name, country);
+  }
+  else
+  {
+    const char *format = dgettext("osso-clock", "cloc_fi_timezonefull");
+
+    return g_strdup_printf(format, utc_offset / -3600, name, country);
+  }
+}
+
+void
+hildon_time_zone_utc_offset_clear_cache()
+{
+  if (offsets)
+  {
+    g_hash_table_destroy(offsets);
+    offsets = NULL;
+  }
+}
@@ -0,0 +1,50 @@
+#ifndef HILDON_TIME_ZONE_UTC_OFFSET_H
+#define HILDON_TIME_ZONE_UTC_OFFSET_H
+
+#include <time.h>
+#include <glib.h>
+#include <cityinfo.h>
+
+G_BEGIN_DECLS
+
+/* Expiry of offsets the zone data says never change again */
+#define HILDON_TIME_ZONE_UTC_OFFSET_NEVER \
+  ((time_t)(sizeof(time_t) == 8 ? G_MAXINT64 : G_MAXINT32))
+
+/**
+ * @brief Returns the current UTC offset of a time zone.
+ *
+ * Offsets are remembered per zone until the next transition found in the
+ * zone data, for good if the zone data rules out later transitions, or else
+ * for a quarter of an hour.
+ *
+ * @param zone The time zone, like "Europe/Helsinki".
+ *
+ * @returns The offset in seconds, like time_get_utc_offset() positive west of
+ *          Greenwich.
+ */
+gint
+hildon_time_zone_utc_offset_get(const gchar *zone);
+
+/**
+ * @brief Formats the label of a city, its UTC offset, name and country.
+ *
+ * @param city A city.
+ * @param expires Return location for the time the UTC offset may change, or
+ *                NULL. #HILDON_TIME_ZONE_UTC_OFFSET_NEVER if it does not.
+ *
+ * @returns A newly allocated string.
+ */
+gchar *
+hildon_time_zone_utc_offset_format_label(const Cityinfo *city,
+                                         time_t *expires);
+
+/**
+ * @brief Forgets all remembered offsets.
+ */
+void
+hildon_time_zone_utc_offset_clear_cache(void);
+
+G_END_DECLS
+
+#endif /* HILDON_TIME_ZONE_UTC_OFFSET_H */
@@ -0,0 +1,327 @@
+#include <glib/gstdio.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hildon-time-zone-zone-map.h"
+
+#define ZONE_MAP_MAGIC "HTZZONE"
+#define ZONE_MAP_VERSION 2
+
+/* One cell per 4x4 pixels of the 1500x919 map */
+#define ZONE_MAP_COLS 375
+#define ZONE_MAP_ROWS 230
+#define ZONE_MAP_NONE 0xffff
+
+/* All fields are in host byte order like the map cache. The header is
+ * followed by the cells, row by row. @checksum identifies the city data the
+ * raster was built from. */
+typedef struct
+{
+  gchar magic[8];
+  guint32 version;
+  guint32 cols;
+  guint32 rows;
+  guint32 n_zones;
+  guint32 checksum;
+} ZoneMapHeader;
+
+/* @cells points into @file when loaded from the cache, else it is owned */
+struct _HildonTimeZoneZoneMap
+{
+  GMappedFile *file;
+  guint16 *cells;
+  gint n_zones;
+};
+
+static gchar *
+_cache_filename(void)
+{
+  return g_build_filename(g_get_user_cache_dir(), "hildon-time-zone-chooser",
+                          "zones.cache", NULL);
+}
+
+static guint32
+_hash_bytes(guint32 hash, gconstpointer data, gsize size)
+{
+  const guchar *p = data;
+  gsize i;
+
+  /* FNV-1a */
+  for (i = 0; i < size; i++)
+    hash = (hash ^ p[i]) * 16777619;
+
+  return hash;
+}
+
+/* Identifies the city data, the raster is rebuilt when it changes */
+static guint32
+_cities_checksum(HildonTimeZoneCityIndex *index)
+{
+  Cityinfo **cities = hildon_time_zone_city_index_get_cities(index);
+  guint32 hash = 2166136261u;
+  gint i;
+
+  for (i = 0; cities && cities[i]; i++)
+  {
+    const gchar *zone = cityinfo_get_zone(cities[i]);
+    float x = cityinfo_get_xpos(cities[i]);
+    float y = cityinfo_get_ypos(cities[i]);
+
+    hash = _hash_bytes(hash, &x, sizeof(x));
+    hash = _hash_bytes(hash, &y, sizeof(y));
+
+    if (zone)
+      hash = _hash_bytes(hash, zone, strlen(zone) + 1);
+  }
+
+  return hash;
+}
+
+static gboolean
+_load(HildonTimeZoneZoneMap *map, guint32 checksum)
+{
+  const ZoneMapHeader *header;
+  const gchar *contents;
+  gchar *filename = _cache_filename();
+  gsize n_cells = ZONE_MAP_COLS * ZONE_MAP_ROWS;
+  gsize length;
+  gsize i;
+
+  map->file = g_mapped_file_new(filename, FALSE, NULL);
+  g_free(filename);
+
+  if (!map->file)
+    return FALSE;
+
+  contents = g_mapped_file_get_contents(map->file);
+  length = g_mapped_file_get_length(map->file);
+  header = (const ZoneMapHeader *)contents;
+
+  if (length < sizeof(*header) ||
+      memcmp(header->magic, ZONE_MAP_MAGIC, sizeof(header->magic)) ||
+      header->version != ZONE_MAP_VERSION ||
+      header->cols != ZONE_MAP_COLS || header->rows != ZONE_MAP_ROWS ||
+      header->checksum != checksum || header->n_zones >= ZONE_MAP_NONE ||
+      length < sizeof(*header) + n_cells * sizeof(guint16))
+  {
+    return FALSE;
+  }
+
+  map->cells = (guint16 *)(contents + sizeof(*header));
+  map->n_zones = header->n_zones;
+
+  for (i = 0; i < n_cells; i++)
+  {
+    if (map->cells[i] != ZONE_MAP_NONE && map->cells[i] >= map->n_zones)
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Gives each cell the zone of the city nearest to its center */
+static void
+_build(HildonTimeZoneZoneMap *map, HildonTimeZoneCityIndex *index)
+{
+  GHashTable *palette = g_hash_table_new(g_str_hash, g_str_equal);
+  gint col;
+  gint row;
+
+  map->cells = g_new(guint16, ZONE_MAP_COLS * ZONE_MAP_ROWS);
+
+  for (row = 0; row < ZONE_MAP_ROWS; row++)
+  {
+    for (col = 0; col < ZONE_MAP_COLS; col++)
+    {
+      const Cityinfo *city = hildon_time_zone_city_index_find_nearest(
+            index, (col + 0.5) / ZONE_MAP_COLS, (row + 0.5) / ZONE_MAP_ROWS,
+            NULL);
+      const gchar *zone = city ? cityinfo_get_zone(city) : NULL;
+      gpointer value;
+      guint16 cell = ZONE_MAP_NONE;
+
+      if (zone && g_hash_table_lookup_extended(palette, zone, NULL, &value))
+        cell = GPOINTER_TO_UINT(value);
+      else if (zone && map->n_zones < ZONE_MAP_NONE)
+      {
+        cell = map->n_zones++;
+        g_hash_table_insert(palette, (gpointer)zone, GUINT_TO_POINTER(cell));
+      }
+
+      map->cells[row * ZONE_MAP_COLS + col] = cell;
+    }
+  }
+
+  g_hash_table_destroy(palette);
+}
+
+static gboolean
+_store(HildonTimeZoneZoneMap *map, guint32 checksum)
+{
+  ZoneMapHeader header = {};
+  gchar *filename = _cache_filename();
+  gchar *dirname = g_path_get_dirname(filename);
+  gchar *tmpname;
+  gboolean ok;
+  FILE *fp;
+  int fd;
+
+  if (g_mkdir_with_parents(dirname, 0755))
+  {
+    g_free(dirname);
+    g_free(filename);
+    return FALSE;
+  }
+
+  g_free(dirname);
+
+  memcpy(header.magic, ZONE_MAP_MAGIC, sizeof(header.magic));
+  header.version = ZONE_MAP_VERSION;
+  header.cols = ZONE_MAP_COLS;
+  header.rows = ZONE_MAP_ROWS;
+  header.n_zones = map->n_zones;
+  header.checksum = checksum;
+
+  /* renamed into place once complete, like the map cache */
+  tmpname = g_strconcat(filename, ".XXXXXX", NULL);
+  fd = g_mkstemp(tmpname);
+
+  if (fd == -1)
+  {
+    g_free(tmpname);
+    g_free(filename);
+    return FALSE;
+  }
+
+  fp = fdopen(fd, "wb");
+
+  if (fp)
+  {
+    ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+        fwrite(map->cells, sizeof(guint16), ZONE_MAP_COLS * ZONE_MAP_ROWS,
+               fp) == ZONE_MAP_COLS * ZONE_MAP_ROWS;
+
+    if (fclose(fp))
+      ok = FALSE;
+  }
+  else
+  {
+    close(fd);
+    ok = FALSE;
+  }
+
+  if (!ok || g_rename(tmpname, filename))
+  {
+    g_unlink(tmpname);
+    ok = FALSE;
+  }
+
+  g_free(tmpname);
+  g_free(filename);
+
+  return ok;
+}
+
+static void
+_clear(HildonTimeZoneZoneMap *map)
+{
+  if (map->file)
+    g_mapped_file_unref(map->file);
+  else
+    g_free(map->cells);
+
+  map->file = NULL;
+  map->cells = NULL;
+  map->n_zones = 0;
+}
+
+HildonTimeZoneZoneMap *
+hildon_time_zone_zone_map_new(HildonTimeZoneCityIndex *index)
+{
+  HildonTimeZoneZoneMap *map;
+  guint32 checksum;
+
+  g_return_val_if_fail(index != NULL, NULL);
+
+  map = g_new0(HildonTimeZoneZoneMap, 1);
+  checksum = _cities_checksum(index);
+
+  if (!_load(map, checksum))
+  {
+    _clear(map);
+    _build(map, index);
+    _store(map, checksum);
+  }
+
+  return map;
+}
+
+void
+hildon_time_zone_zone_map_free(HildonTimeZoneZoneMap *map)
+{
+  if (!map)
+    return;
+
+  _clear(map);
+  g_free(map);
+}
+
+void
+hildon_time_zone_zone_map_get_size(HildonTimeZoneZoneMap *map, gint *cols,
+                                   gint *rows)
+{
+  *cols = ZONE_MAP_COLS;
+  *rows = ZONE_MAP_ROWS;
+}
+
+gint
+hildon_time_zone_zone_map_lookup(HildonTimeZoneZoneMap *map, double x,
+                                 double y)
+{
+  gint col;
+  gint row;
+  guint16 cell;
+
+  g_return_val_if_fail(map != NULL, -1);
+
+  col = (gint)((x - floor(x)) * ZONE_MAP_COLS);
+  row = (gint)((y - floor(y)) * ZONE_MAP_ROWS);
+  /* floor() rounding can leave exactly 1.0 for tiny negative values */
+  cell = map->cells[MIN(row, ZONE_MAP_ROWS - 1) * ZONE_MAP_COLS +
+                    MIN(col, ZONE_MAP_COLS - 1)];
+
+  return cell == ZONE_MAP_NONE ? -1 : cell;
+}
+
+cairo_surface_t *
+hildon_time_zone_zone_map_create_mask(HildonTimeZoneZoneMap *map, gint zone)
+{
+  cairo_surface_t *surface;
+  guchar *data;
+  gint stride;
+  gint col;
+  gint row;
+
+  g_return_val_if_fail(map != NULL, NULL);
+
+  surface = cairo_image_surface_create(CAIRO_FORMAT_A8, ZONE_MAP_COLS,
+                                       ZONE_MAP_ROWS);
+  cairo_surface_flush(surface);
+  data = cairo_image_surface_get_data(surface);
+  stride = cairo_image_surface_get_stride(surface);
+
+  for (row = 0; row < ZONE_MAP_ROWS; row++)
+  {
+    const guint16 *cells = map->cells + row * ZONE_MAP_COLS;
+    guchar *out = data + row * stride;
+
+    for (col = 0; col < ZONE_MAP_COLS; col++)
+      out[col] = cells[col] == zone ? 0xff : 0x00;
+  }
+
+  cairo_surface_mark_dirty(surface);
+
+  return surface;
+}
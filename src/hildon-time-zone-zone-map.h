@@ -0,0 +1,79 @@
+#ifndef HILDON_TIME_ZONE_ZONE_MAP_H
+#define HILDON_TIME_ZONE_ZONE_MAP_H
+
+#include <gdk/gdk.h>
+
+#include "hildon-time-zone-city-index.h"
+
+G_BEGIN_DECLS
+
+/*
+ * A raster of the time zones over the world map. Each cell holds the index of
+ * the zone of the city nearest to its center, the cells of a zone sharing
+ * one. The raster is built from the city database and kept in the user cache
+ * directory, until the city database changes.
+ */
+typedef struct _HildonTimeZoneZoneMap HildonTimeZoneZoneMap;
+
+/**
+ * @brief Loads the zone raster from the cache, building it if the cache is
+ *        missing or stale.
+ *
+ * Building takes tens of thousands of nearest city lookups. The function
+ * touches no shared state, so it can run on a worker thread as long as
+ * @index is kept alive.
+ *
+ * @param index The cities to build the raster from.
+ *
+ * @returns A new raster. Free with #hildon_time_zone_zone_map_free().
+ */
+HildonTimeZoneZoneMap *
+hildon_time_zone_zone_map_new(HildonTimeZoneCityIndex *index);
+
+/**
+ * @brief Frees a raster returned by #hildon_time_zone_zone_map_new().
+ *
+ * @param map A #HildonTimeZoneZoneMap, or NULL.
+ */
+void
+hildon_time_zone_zone_map_free(HildonTimeZoneZoneMap *map);
+
+/**
+ * @brief Returns the size of the raster in cells.
+ *
+ * @param map A #HildonTimeZoneZoneMap.
+ * @param cols Return location for the number of columns.
+ * @param rows Return location for the number of rows.
+ */
+void
+hildon_time_zone_zone_map_get_size(HildonTimeZoneZoneMap *map, gint *cols,
+                                   gint *rows);
+
+/**
+ * @brief Looks up the zone at a map position.
+ *
+ * @param map A #HildonTimeZoneZoneMap.
+ * @param x Horizontal map position, normalized like city positions.
+ * @param y Vertical map position.
+ *
+ * @returns The zone index, or -1 if no zone covers the position.
+ */
+gint
+hildon_time_zone_zone_map_lookup(HildonTimeZoneZoneMap *map, double x,
+                                 double y);
+
+/**
+ * @brief Renders the cells of a zone into a new alpha mask covering the whole
+ *        map, one pixel per cell.
+ *
+ * @param map A #HildonTimeZoneZoneMap.
+ * @param zone A zone index.
+ *
+ * @returns A new CAIRO_FORMAT_A8 image surface.
+ */
+cairo_surface_t *
+hildon_time_zone_zone_map_create_mask(HildonTimeZoneZoneMap *map, gint zone);
+
+G_END_DECLS
+
+#endif /* HILDON_TIME_ZONE_ZONE_MAP_H */
@@ -0,0 +1,233 @@
+/* Checks the vectorized daylight shading kernels against the scalar one and
+ * the shape of the mask. The sources are included for their static
+ * functions. */
+
+#include "hildon-time-zone-city-index.c"
+#include "hildon-time-zone-daylight.c"
+
+/* Row lengths tested, covers every tail of the widest kernel several times */
+#define TEST_MAX_LENGTH 70
+
+#define TEST_MASK_WIDTH 360
+#define TEST_MASK_HEIGHT 180
+
+/* A tenth of a degree per pixel, the alpha changes by about 1.5 from one
+ * to the next near the terminator */
+#define TEST_SHAPE_WIDTH 3600
+#define TEST_SHAPE_HEIGHT 1800
+
+typedef struct
+{
+  const gchar *name;
+  DaylightShadeRowFn shade_row;
+} ShadeKernel;
+
+static ShadeKernel kernels[4];
+static gint n_kernels = 0;
+
+static void
+_add_kernel(const gchar *name, DaylightShadeRowFn fn)
+{
+  kernels[n_kernels].name = name;
+  kernels[n_kernels].shade_row = fn;
+  n_kernels++;
+}
+
+/* The kernels this CPU can run, besides the scalar one */
+static void
+_find_kernels(void)
+{
+#ifdef DAYLIGHT_X86
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("sse2"))
+    _add_kernel("sse2", _shade_row_sse2);
+
+  if (__builtin_cpu_supports("avx2"))
+    _add_kernel("avx2", _shade_row_avx2);
+#endif
+
+#ifdef DAYLIGHT_NEON
+  _add_kernel("neon", _shade_row_neon);
+#endif
+}
+
+static void
+_assert_row_matches(const ShadeKernel *kernel, const float *c, float a,
+                    float b, float max, gsize n)
+{
+  guchar expected[TEST_MAX_LENGTH + 1];
+  guchar result[TEST_MAX_LENGTH + 1];
+
+  memset(expected, 0xa5, sizeof(expected));
+  memset(result, 0xa5, sizeof(result));
+  _shade_row_c(c, a, b, max, expected, n);
+  kernel->shade_row(c, a, b, max, result, n);
+
+  if (memcmp(expected, result, sizeof(result)))
+  {
+    g_error("%s shade_row differs for %" G_GSIZE_FORMAT " values, "
+            "a %g b %g max %g", kernel->name, n, a, b, max);
+  }
+}
+
+/* Rows of every length, with the sums spread beyond both clamps */
+static void
+test_shade_row(void)
+{
+  float c[TEST_MAX_LENGTH];
+  gint k;
+  gint n;
+  gint i;
+
+  for (k = 0; k < n_kernels; k++)
+  {
+    for (n = 0; n <= TEST_MAX_LENGTH; n++)
+    {
+      float a = g_test_rand_double_range(-100.0, 355.0);
+      float b = g_test_rand_double_range(-600.0, 600.0);
+      float max = g_test_rand_int_range(1, 256);
+
+      for (i = 0; i < n; i++)
+        c[i] = g_test_rand_double_range(-1.0, 1.0);
+
+      _assert_row_matches(&kernels[k], c, a, b, max, n);
+    }
+  }
+}
+
+/* Sums exactly halfway between two alphas round up in every kernel, the
+ * rounding conversions of SSE2 and AVX2 would round them to even */
+static void
+test_shade_row_halfway(void)
+{
+  float c[TEST_MAX_LENGTH];
+  gint k;
+  gint i;
+
+  for (i = 0; i < TEST_MAX_LENGTH; i++)
+    c[i] = (i % 9 - 4) / 4.0f;
+
+  for (k = 0; k < n_kernels; k++)
+  {
+    float a;
+
+    for (a = 0.5f; a < 255.0f; a += 1.0f)
+    {
+      guchar alpha[TEST_MAX_LENGTH];
+
+      _assert_row_matches(&kernels[k], c, a, 0.0f, 255.0f, TEST_MAX_LENGTH);
+      _assert_row_matches(&kernels[k], c, a, 2.0f, 255.0f, TEST_MAX_LENGTH);
+
+      kernels[k].shade_row(c, a, 0.0f, 255.0f, alpha, TEST_MAX_LENGTH);
+      g_assert_cmpint(alpha[TEST_MAX_LENGTH - 1], ==, (gint)a + 1);
+    }
+  }
+}
+
+/* Whole masks of the world, shaded the way the map does with each kernel */
+static void
+test_mask(void)
+{
+  HildonTimeZoneMapBounds bounds = { -180.0, 180.0, 90.0, -90.0 };
+  DaylightShadeRowFn best;
+  time_t t = 1700000000;
+  gint k;
+  gint i;
+
+  _init_kernels();
+  best = shade_row;
+
+  for (i = 0; i < 4; i++, t += 7 * 86400 + 5 * 3600)
+  {
+    cairo_surface_t *expected;
+    gint y;
+
+    shade_row = _shade_row_c;
+    expected = hildon_time_zone_daylight_create_mask(
+          &bounds, TEST_MASK_WIDTH, TEST_MASK_HEIGHT, t, 200);
+
+    for (k = 0; k < n_kernels; k++)
+    {
+      cairo_surface_t *result;
+
+      shade_row = kernels[k].shade_row;
+      result = hildon_time_zone_daylight_create_mask(
+            &bounds, TEST_MASK_WIDTH, TEST_MASK_HEIGHT, t, 200);
+
+      for (y = 0; y < TEST_MASK_HEIGHT; y++)
+      {
+        g_assert(!memcmp(cairo_image_surface_get_data(expected) +
+                         y * cairo_image_surface_get_stride(expected),
+                         cairo_image_surface_get_data(result) +
+                         y * cairo_image_surface_get_stride(result),
+                         TEST_MASK_WIDTH));
+      }
+
+      cairo_surface_destroy(result);
+    }
+
+    cairo_surface_destroy(expected);
+  }
+
+  shade_row = best;
+}
+
+static guchar
+_mask_alpha(cairo_surface_t *mask, double lon, double lat)
+{
+  gint width = cairo_image_surface_get_width(mask);
+  gint height = cairo_image_surface_get_height(mask);
+  gint x = (lon + 180.0) / 360.0 * width;
+  gint y = (90.0 - lat) / 180.0 * height;
+
+  x = CLAMP(x, 0, width - 1);
+  y = CLAMP(y, 0, height - 1);
+
+  return cairo_image_surface_get_data(mask)[
+        y * cairo_image_surface_get_stride(mask) + x];
+}
+
+/* Clear under the sun, fully shaded opposite to it, and half way shaded
+ * along the terminator */
+static void
+test_mask_shape(void)
+{
+  HildonTimeZoneMapBounds bounds = { -180.0, 180.0, 90.0, -90.0 };
+  time_t t = 1700000000;
+  cairo_surface_t *mask;
+  double declination;
+  double noon;
+  double lon;
+  double lat;
+
+  _sun_position(t, &declination, &noon);
+  mask = hildon_time_zone_daylight_create_mask(&bounds, TEST_SHAPE_WIDTH,
+                                               TEST_SHAPE_HEIGHT, t, 200);
+
+  lon = remainder(noon / DEG_TO_RAD, 360.0);
+  lat = declination / DEG_TO_RAD;
+  g_assert_cmpint(_mask_alpha(mask, lon, lat), ==, 0);
+  g_assert_cmpint(_mask_alpha(mask, remainder(lon + 180.0, 360.0), -lat), ==,
+                  200);
+
+  /* the terminator crosses the equator a quarter turn from noon */
+  g_assert_cmpint(ABS(_mask_alpha(mask, remainder(lon + 90.0, 360.0), 0.0) -
+                      100), <=, 2);
+
+  cairo_surface_destroy(mask);
+}
+
+int
+main(int argc, char **argv)
+{
+  g_test_init(&argc, &argv, NULL);
+  _find_kernels();
+
+  g_test_add_func("/daylight/shade-row", test_shade_row);
+  g_test_add_func("/daylight/shade-row-halfway", test_shade_row_halfway);
+  g_test_add_func("/daylight/mask", test_mask);
+  g_test_add_func("/daylight/mask-shape", test_mask_shape);
+
+  return g_test_run();
+}
@@ -0,0 +1,283 @@
+/* Checks the vectorized map scaling kernels against the scalar ones and
+ * times the scaler against gdk_pixbuf_scale_simple(). The source is included
+ * for its static kernels. */
+
+#include "hildon-time-zone-map-scale.c"
+
+/* Row lengths tested, covers every tail of the widest kernel twice */
+#define TEST_MAX_LENGTH 130
+
+#define TEST_MAP_WIDTH 1500
+#define TEST_MAP_HEIGHT 919
+#define TEST_BENCHMARK_RUNS 3
+
+typedef struct
+{
+  const gchar *name;
+  MapBlendRowsFn blend_rows;
+  MapAccumulateRowFn accumulate_row;
+} ScaleKernels;
+
+static ScaleKernels kernels[4];
+static gint n_kernels = 0;
+
+static void
+_add_kernels(const gchar *name, MapBlendRowsFn blend,
+             MapAccumulateRowFn accumulate)
+{
+  kernels[n_kernels].name = name;
+  kernels[n_kernels].blend_rows = blend;
+  kernels[n_kernels].accumulate_row = accumulate;
+  n_kernels++;
+}
+
+/* The kernels this CPU can run, besides the scalar ones */
+static void
+_find_kernels(void)
+{
+#ifdef MAP_SCALE_X86
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("sse2"))
+    _add_kernels("sse2", _blend_rows_sse2, _accumulate_row_sse2);
+
+  if (__builtin_cpu_supports("avx2"))
+    _add_kernels("avx2", _blend_rows_avx2, _accumulate_row_avx2);
+#endif
+
+#ifdef MAP_SCALE_NEON
+  _add_kernels("neon", _blend_rows_neon, _accumulate_row_neon);
+#endif
+}
+
+static GdkPixbuf *
+_random_pixbuf(gint width, gint height)
+{
+  GdkPixbuf *pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, width,
+                                     height);
+  guchar *pixels = gdk_pixbuf_get_pixels(pixbuf);
+  gint stride = gdk_pixbuf_get_rowstride(pixbuf);
+  gint x;
+  gint y;
+
+  for (y = 0; y < height; y++)
+  {
+    for (x = 0; x < width * 3; x++)
+      pixels[y * stride + x] = g_test_rand_int_range(0, 256);
+  }
+
+  return pixbuf;
+}
+
+static void
+_assert_pixbufs_equal(GdkPixbuf *a, GdkPixbuf *b)
+{
+  gint width = gdk_pixbuf_get_width(a);
+  gint height = gdk_pixbuf_get_height(a);
+  gint y;
+
+  g_assert_cmpint(width, ==, gdk_pixbuf_get_width(b));
+  g_assert_cmpint(height, ==, gdk_pixbuf_get_height(b));
+
+  for (y = 0; y < height; y++)
+  {
+    g_assert(!memcmp(gdk_pixbuf_get_pixels(a) +
+                     y * gdk_pixbuf_get_rowstride(a),
+                     gdk_pixbuf_get_pixels(b) +
+                     y * gdk_pixbuf_get_rowstride(b),
+                     width * 3));
+  }
+}
+
+/* Every length up to TEST_MAX_LENGTH, at aligned and unaligned addresses,
+ * with random sums up to the largest the upscale makes. The byte past the
+ * row must stay untouched. */
+static void
+test_blend_rows(void)
+{
+  guint16 a[TEST_MAX_LENGTH + 1];
+  guint16 b[TEST_MAX_LENGTH + 1];
+  guchar expected[TEST_MAX_LENGTH + 2];
+  guchar result[TEST_MAX_LENGTH + 2];
+  gint k;
+  gint n;
+  gint skew;
+  gint i;
+
+  for (k = 0; k < n_kernels; k++)
+  {
+    for (skew = 0; skew < 2; skew++)
+    {
+      for (n = 0; n + skew <= TEST_MAX_LENGTH; n++)
+      {
+        for (i = 0; i < TEST_MAX_LENGTH + 1; i++)
+        {
+          a[i] = g_test_rand_int_range(0, 4 * 255 + 1);
+          b[i] = g_test_rand_int_range(0, 4 * 255 + 1);
+        }
+
+        /* the largest sum must not overflow */
+        if (n)
+          a[skew] = b[skew] = 4 * 255;
+
+        memset(expected, 0xa5, sizeof(expected));
+        memset(result, 0xa5, sizeof(result));
+        _blend_rows_c(a + skew, b + skew, expected + skew, n);
+        kernels[k].blend_rows(a + skew, b + skew, result + skew, n);
+
+        if (memcmp(expected, result, sizeof(result)))
+        {
+          g_error("%s blend_rows differs for %d values at offset %d",
+                  kernels[k].name, n, skew);
+        }
+      }
+    }
+  }
+}
+
+static void
+test_accumulate_row(void)
+{
+  guchar src[TEST_MAX_LENGTH + 1];
+  guint16 expected[TEST_MAX_LENGTH + 2];
+  guint16 result[TEST_MAX_LENGTH + 2];
+  gint k;
+  gint n;
+  gint skew;
+  gint i;
+
+  for (k = 0; k < n_kernels; k++)
+  {
+    for (skew = 0; skew < 2; skew++)
+    {
+      for (n = 0; n + skew <= TEST_MAX_LENGTH; n++)
+      {
+        guint16 weight = g_test_rand_int_range(0, MAP_SCALE_WEIGHT_ONE + 1);
+
+        for (i = 0; i < TEST_MAX_LENGTH + 1; i++)
+          src[i] = g_test_rand_int_range(0, 256);
+
+        for (i = 0; i < TEST_MAX_LENGTH + 2; i++)
+          expected[i] = result[i] = g_test_rand_int_range(0, 1 << 15);
+
+        _accumulate_row_c(src + skew, weight, expected + skew, n);
+        kernels[k].accumulate_row(src + skew, weight, result + skew, n);
+
+        if (memcmp(expected, result, sizeof(result)))
+        {
+          g_error("%s accumulate_row differs for %d values at offset %d",
+                  kernels[k].name, n, skew);
+        }
+      }
+    }
+  }
+}
+
+/* Whole images of odd sizes, scaled like the map levels */
+static void
+test_scale_images(void)
+{
+  GdkPixbuf *src = _random_pixbuf(301, 187);
+  const gint sizes[][2] = { { 602, 374 }, { 133, 83 }, { 301, 187 },
+                            { 1, 1 } };
+  MapBlendRowsFn best_blend_rows;
+  MapAccumulateRowFn best_accumulate_row;
+  gint s;
+  gint k;
+
+  _init_kernels();
+  best_blend_rows = blend_rows;
+  best_accumulate_row = accumulate_row;
+
+  for (s = 0; s < (gint)G_N_ELEMENTS(sizes); s++)
+  {
+    GdkPixbuf *expected;
+
+    blend_rows = _blend_rows_c;
+    accumulate_row = _accumulate_row_c;
+    expected = hildon_time_zone_map_scale(src, sizes[s][0], sizes[s][1]);
+
+    for (k = 0; k < n_kernels; k++)
+    {
+      GdkPixbuf *result;
+
+      blend_rows = kernels[k].blend_rows;
+      accumulate_row = kernels[k].accumulate_row;
+      result = hildon_time_zone_map_scale(src, sizes[s][0], sizes[s][1]);
+      _assert_pixbufs_equal(expected, result);
+      g_object_unref(result);
+    }
+
+    g_object_unref(expected);
+  }
+
+  blend_rows = best_blend_rows;
+  accumulate_row = best_accumulate_row;
+  g_object_unref(src);
+}
+
+static double
+_time_scale(GdkPixbuf *src, gint width, gint height, gboolean simple)
+{
+  double best = G_MAXDOUBLE;
+  gint i;
+
+  for (i = 0; i < TEST_BENCHMARK_RUNS; i++)
+  {
+    GdkPixbuf *dst;
+    double elapsed;
+
+    g_test_timer_start();
+
+    if (simple)
+      dst = gdk_pixbuf_scale_simple(src, width, height, GDK_INTERP_BILINEAR);
+    else
+      dst = hildon_time_zone_map_scale(src, width, height);
+
+    elapsed = g_test_timer_elapsed();
+    g_object_unref(dst);
+    best = MIN(best, elapsed);
+  }
+
+  return best;
+}
+
+/* The map levels the chooser makes from the 1500x919 map, with the kernels
+ * this CPU picks */
+static void
+test_benchmark(void)
+{
+  GdkPixbuf *src = _random_pixbuf(TEST_MAP_WIDTH, TEST_MAP_HEIGHT);
+  const float scales[] = { 0.444f, 2.0f };
+  gint s;
+
+  for (s = 0; s < (gint)G_N_ELEMENTS(scales); s++)
+  {
+    gint width = TEST_MAP_WIDTH * scales[s];
+    gint height = TEST_MAP_HEIGHT * scales[s];
+    double kernel = _time_scale(src, width, height, FALSE);
+    double simple = _time_scale(src, width, height, TRUE);
+
+    g_test_message("%dx%d: %.1f ms, gdk_pixbuf_scale_simple %.1f ms",
+                   width, height, kernel * 1000, simple * 1000);
+    g_test_maximized_result(simple / kernel,
+                            "%dx%d speedup over gdk_pixbuf_scale_simple %.2f",
+                            width, height, simple / kernel);
+  }
+
+  g_object_unref(src);
+}
+
+int
+main(int argc, char **argv)
+{
+  g_test_init(&argc, &argv, NULL);
+  _find_kernels();
+
+  g_test_add_func("/map-scale/blend-rows", test_blend_rows);
+  g_test_add_func("/map-scale/accumulate-row", test_accumulate_row);
+  g_test_add_func("/map-scale/scale-images", test_scale_images);
+  g_test_add_func("/map-scale/benchmark", test_benchmark);
+
+  return g_test_run();
+}
@@ -0,0 +1,339 @@
+/* Checks the search index against plain reference implementations: the
+ * bit-parallel edit distance against dynamic programming, narrowing as the
+ * text is typed against querying afresh and the top rows against a full
+ * sort. The source is included for its static functions. */
+
+#include "hildon-time-zone-search-index.c"
+
+/* Rows of the random index */
+#define TEST_N_ROWS 3000
+
+#define TEST_MAX_ROWS 20
+
+static const gchar *syllables[] =
+{
+  "ha", "hel", "sin", "ki", "sa", "o", "pau", "lo", "ber", "lin", "ma",
+  "drid", "new", " york", "san", "ta", "-", "ro", "me", "par", "is", "to"
+};
+
+static const gchar *countries[] = { "finland", "brazil", "germany", "spain" };
+
+static gchar *
+_random_name(void)
+{
+  GString *name = g_string_new(NULL);
+  gint n = g_test_rand_int_range(1, 6);
+  gint i;
+
+  for (i = 0; i < n; i++)
+  {
+    g_string_append(name,
+                    syllables[g_test_rand_int_range(
+                          0, G_N_ELEMENTS(syllables))]);
+  }
+
+  return g_string_free(name, FALSE);
+}
+
+/* An index of random names, with "São Paulo" as the last row */
+static HildonTimeZoneSearchIndex *
+_random_index(void)
+{
+  GString *keys = g_string_new(NULL);
+  gint row;
+
+  for (row = 0; row < TEST_N_ROWS - 1; row++)
+  {
+    gchar *name = _random_name();
+
+    _append_key(keys, name,
+                countries[g_test_rand_int_range(0, G_N_ELEMENTS(countries))]);
+    g_free(name);
+  }
+
+  _append_key(keys, "São Paulo", "Brasil");
+
+  return _index_new(g_string_free(keys, FALSE), TEST_N_ROWS);
+}
+
+/* The pattern of @text, with the bit vectors set up whatever its length */
+static void
+_pattern_init_all(SearchPattern *pattern, const gchar *text)
+{
+  gsize i;
+
+  _pattern_init(pattern, text);
+  memset(pattern->peq, 0, sizeof(pattern->peq));
+
+  for (i = 0; i < pattern->len; i++)
+    pattern->peq[(guchar)text[i]] |= G_GUINT64_CONSTANT(1) << i;
+}
+
+/* The fewest edits turning @pattern into a substring of @key, filling the
+ * whole matrix. @end is the first position where the best substring ends. */
+static gint
+_reference_distance(const gchar *pattern, const gchar *key, gint *end)
+{
+  gint m = strlen(pattern);
+  gint n = strlen(key);
+  gint *prev = g_new(gint, m + 1);
+  gint *cur = g_new(gint, m + 1);
+  gint best = m;
+  gint i;
+  gint j;
+
+  *end = 0;
+
+  for (i = 0; i <= m; i++)
+    prev[i] = i;
+
+  for (j = 1; j <= n; j++)
+  {
+    gint *tmp;
+
+    cur[0] = 0;
+
+    for (i = 1; i <= m; i++)
+    {
+      cur[i] = prev[i - 1] + (pattern[i - 1] != key[j - 1]);
+      cur[i] = MIN(cur[i], prev[i] + 1);
+      cur[i] = MIN(cur[i], cur[i - 1] + 1);
+    }
+
+    if (cur[m] < best)
+    {
+      best = cur[m];
+      *end = j - 1;
+    }
+
+    tmp = prev;
+    prev = cur;
+    cur = tmp;
+  }
+
+  g_free(prev);
+  g_free(cur);
+
+  return best;
+}
+
+static gchar *
+_random_text(gint len, gint alphabet)
+{
+  gchar *text = g_new(gchar, len + 1);
+  gint i;
+
+  for (i = 0; i < len; i++)
+    text[i] = 'a' + g_test_rand_int_range(0, alphabet);
+
+  text[len] = 0;
+
+  return text;
+}
+
+static void
+test_edit_distance(void)
+{
+  gint i;
+
+  for (i = 0; i < 20000; i++)
+  {
+    gint alphabet = g_test_rand_int_range(2, 27);
+    gchar *text = _random_text(
+          g_test_rand_int_range(1, SEARCH_INDEX_MAX_FUZZY + 1), alphabet);
+    gchar *key = _random_text(g_test_rand_int_range(0, 65), alphabet);
+    SearchPattern pattern;
+    gint expected_end;
+    gint expected;
+    gint end;
+
+    _pattern_init_all(&pattern, text);
+    expected = _reference_distance(text, key, &expected_end);
+
+    g_assert_cmpint(_edit_distance(&pattern, key, &end), ==, expected);
+    g_assert_cmpint(end, ==, expected_end);
+
+    g_free(text);
+    g_free(key);
+  }
+}
+
+static void
+_assert_same_matches(GArray *matches, GArray *expected)
+{
+  guint i;
+
+  g_assert_cmpuint(matches->len, ==, expected->len);
+
+  for (i = 0; i < matches->len; i++)
+  {
+    SearchMatch *a = &g_array_index(matches, SearchMatch, i);
+    SearchMatch *b = &g_array_index(expected, SearchMatch, i);
+
+    g_assert_cmpuint(a->row, ==, b->row);
+    g_assert_cmpuint(a->rank, ==, b->rank);
+  }
+}
+
+/* The text of a random row, with a typo now and then */
+static gchar *
+_random_query(HildonTimeZoneSearchIndex *index)
+{
+  const gchar *key = _get_key(index, g_test_rand_int_range(0, index->n_rows));
+  gchar *text = g_strndup(key, strcspn(key, "\n"));
+  gsize len = strlen(text);
+
+  if (len > 4 && g_test_rand_bit())
+    text[g_test_rand_int_range(0, len)] = 'x';
+
+  return text;
+}
+
+/* Whatever the filter kept from the previous text, its matches are those of
+ * a fresh query */
+static void
+test_typing(void)
+{
+  HildonTimeZoneSearchIndex *index = _random_index();
+  HildonTimeZoneSearchFilter *filter =
+      hildon_time_zone_search_filter_new(index);
+  GArray *expected = g_array_new(FALSE, FALSE, sizeof(SearchMatch));
+  gint i;
+
+  for (i = 0; i < 200; i++)
+  {
+    gchar *text = _random_query(index);
+    gsize len = strlen(text);
+    gsize n;
+
+    /* typed one key at a time, then erased again */
+    for (n = 1; n <= 2 * len; n++)
+    {
+      gchar *typed = g_strndup(text, n <= len ? n : 2 * len - n);
+      gchar *normalized = hildon_time_zone_search_index_normalize(typed);
+      SearchPattern pattern;
+
+      g_strstrip(normalized);
+      hildon_time_zone_search_filter_set_text(filter, typed);
+
+      if (*normalized)
+      {
+        _pattern_init(&pattern, normalized);
+        _query(index, &pattern, expected);
+        _assert_same_matches(filter->matches, expected);
+      }
+      else
+        g_assert(hildon_time_zone_search_filter_matches_all(filter));
+
+      g_free(normalized);
+      g_free(typed);
+    }
+
+    g_free(text);
+  }
+
+  g_array_free(expected, TRUE);
+  hildon_time_zone_search_filter_free(filter);
+  hildon_time_zone_search_index_free(index);
+}
+
+static void
+test_accents(void)
+{
+  HildonTimeZoneSearchIndex *index = _random_index();
+  HildonTimeZoneSearchFilter *filter =
+      hildon_time_zone_search_filter_new(index);
+  const guint32 *rows;
+  gint n_rows;
+
+  hildon_time_zone_search_filter_set_text(filter, "sao paulo");
+  rows = hildon_time_zone_search_filter_get_rows(filter, TEST_MAX_ROWS,
+                                                 &n_rows);
+  g_assert_cmpint(n_rows, >, 0);
+  g_assert_cmpuint(rows[0], ==, TEST_N_ROWS - 1);
+
+  /* and the other way round */
+  hildon_time_zone_search_filter_set_text(filter, "SÃO PAULO");
+  rows = hildon_time_zone_search_filter_get_rows(filter, TEST_MAX_ROWS,
+                                                 &n_rows);
+  g_assert_cmpint(n_rows, >, 0);
+  g_assert_cmpuint(rows[0], ==, TEST_N_ROWS - 1);
+
+  hildon_time_zone_search_filter_free(filter);
+  hildon_time_zone_search_index_free(index);
+}
+
+static int
+_compare_matches(const void *a, const void *b)
+{
+  guint64 x = HEAP_KEY((const SearchMatch *)a);
+  guint64 y = HEAP_KEY((const SearchMatch *)b);
+
+  return x < y ? -1 : x > y;
+}
+
+/* The best rows come out in the order of sorting all matches */
+static void
+test_rows_order(void)
+{
+  HildonTimeZoneSearchIndex *index = _random_index();
+  HildonTimeZoneSearchFilter *filter =
+      hildon_time_zone_search_filter_new(index);
+  static const gint max_rows[] = { 1, 2, 7, TEST_MAX_ROWS, TEST_N_ROWS };
+  gint i;
+
+  for (i = 0; i < 100; i++)
+  {
+    gchar *text = _random_query(index);
+    SearchMatch *sorted;
+    guint n_matches;
+    guint k;
+
+    /* a prefix, so that there are plenty of matches */
+    text[g_test_rand_int_range(1, MIN(strlen(text), 5) + 1)] = 0;
+    hildon_time_zone_search_filter_set_text(filter, text);
+    g_free(text);
+
+    if (hildon_time_zone_search_filter_matches_all(filter))
+      continue;
+
+    n_matches = filter->matches->len;
+    sorted = g_memdup(filter->matches->data,
+                      n_matches * sizeof(SearchMatch));
+    qsort(sorted, n_matches, sizeof(SearchMatch), _compare_matches);
+
+    for (k = 0; k < G_N_ELEMENTS(max_rows); k++)
+    {
+      const guint32 *rows;
+      gint n_rows;
+      gint j;
+
+      /* the ranking is kept for as many rows as were asked for */
+      g_array_set_size(filter->ranked, 0);
+      rows = hildon_time_zone_search_filter_get_rows(filter, max_rows[k],
+                                                     &n_rows);
+      g_assert_cmpint(n_rows, ==, MIN((guint)max_rows[k], n_matches));
+
+      for (j = 0; j < n_rows; j++)
+        g_assert_cmpuint(rows[j], ==, sorted[j].row);
+    }
+
+    g_free(sorted);
+  }
+
+  hildon_time_zone_search_filter_free(filter);
+  hildon_time_zone_search_index_free(index);
+}
+
+int
+main(int argc, char **argv)
+{
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/search-index/edit-distance", test_edit_distance);
+  g_test_add_func("/search-index/typing", test_typing);
+  g_test_add_func("/search-index/accents", test_accents);
+  g_test_add_func("/search-index/rows-order", test_rows_order);
+
+  return g_test_run();
+}
@@ -0,0 +1,320 @@
+/* Writes small tiled map containers like the packing tool does and reads
+ * their tiles back. PNG tiles keep the pixels exact. */
+
+#include <glib/gstdio.h>
+#include <unistd.h>
+
+#include "hildon-time-zone-tiled-map.c"
+
+#define TEST_TILE_SIZE 32
+
+/* Sizes of the levels, the tiles of the last row and column are cut */
+static const gint levels[][2] = { { 70, 45 }, { 140, 90 } };
+
+typedef struct
+{
+  GdkPixbuf *images[G_N_ELEMENTS(levels)];
+  /* the encoded tiles of all levels, row by row */
+  GPtrArray *tiles;
+  gchar *filename;
+} TestContainer;
+
+static GdkPixbuf *
+_random_pixbuf(gint width, gint height)
+{
+  GdkPixbuf *pixbuf = gdk_pixbuf_new(GDK_COLORSPACE_RGB, FALSE, 8, width,
+                                     height);
+  guchar *pixels = gdk_pixbuf_get_pixels(pixbuf);
+  gint stride = gdk_pixbuf_get_rowstride(pixbuf);
+  gint x;
+  gint y;
+
+  for (y = 0; y < height; y++)
+  {
+    for (x = 0; x < width * 3; x++)
+      pixels[y * stride + x] = g_test_rand_int_range(0, 256);
+  }
+
+  return pixbuf;
+}
+
+/* Tile number @missing is listed as missing */
+static GByteArray *
+_pack(TestContainer *c, guint missing)
+{
+  GPtrArray *tiles = g_ptr_array_new();
+  GBytes *empty = g_bytes_new(NULL, 0);
+  GByteArray *data;
+  guint i;
+
+  for (i = 0; i < c->tiles->len; i++)
+  {
+    g_ptr_array_add(tiles, i == missing ? empty :
+                    g_ptr_array_index(c->tiles, i));
+  }
+
+  data = hildon_time_zone_tiled_map_pack(TEST_TILE_SIZE, levels[0],
+                                         G_N_ELEMENTS(levels), tiles);
+  g_ptr_array_free(tiles, TRUE);
+  g_bytes_unref(empty);
+
+  return data;
+}
+
+static void
+_write(TestContainer *c, GByteArray *data)
+{
+  GError *error = NULL;
+
+  g_file_set_contents(c->filename, (const gchar *)data->data, data->len,
+                      &error);
+  g_assert_no_error(error);
+  g_byte_array_free(data, TRUE);
+}
+
+static void
+_container_init(TestContainer *c)
+{
+  gint fd;
+  guint i;
+
+  c->tiles = g_ptr_array_new_with_free_func((GDestroyNotify)g_bytes_unref);
+
+  for (i = 0; i < G_N_ELEMENTS(levels); i++)
+  {
+    gint x;
+    gint y;
+
+    c->images[i] = _random_pixbuf(levels[i][0], levels[i][1]);
+
+    for (y = 0; y < levels[i][1]; y += TEST_TILE_SIZE)
+    {
+      for (x = 0; x < levels[i][0]; x += TEST_TILE_SIZE)
+      {
+        GdkPixbuf *tile = gdk_pixbuf_new_subpixbuf(
+              c->images[i], x, y, MIN(TEST_TILE_SIZE, levels[i][0] - x),
+              MIN(TEST_TILE_SIZE, levels[i][1] - y));
+        GError *error = NULL;
+        gchar *buffer;
+        gsize length;
+
+        gdk_pixbuf_save_to_buffer(tile, &buffer, &length, "png", &error,
+                                  NULL);
+        g_assert_no_error(error);
+        g_ptr_array_add(c->tiles, g_bytes_new_take(buffer, length));
+        g_object_unref(tile);
+      }
+    }
+  }
+
+  fd = g_file_open_tmp("test-tiled-map-XXXXXX", &c->filename, NULL);
+  g_assert(fd >= 0);
+  close(fd);
+}
+
+static void
+_container_clear(TestContainer *c)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS(levels); i++)
+    g_object_unref(c->images[i]);
+
+  g_ptr_array_free(c->tiles, TRUE);
+  g_unlink(c->filename);
+  g_free(c->filename);
+}
+
+static void
+_assert_tile(GdkPixbuf *tile, GdkPixbuf *image, gint x, gint y)
+{
+  gint width = gdk_pixbuf_get_width(tile);
+  gint height = gdk_pixbuf_get_height(tile);
+  gint row;
+
+  g_assert_cmpint(width, ==,
+                  MIN(TEST_TILE_SIZE, gdk_pixbuf_get_width(image) - x));
+  g_assert_cmpint(height, ==,
+                  MIN(TEST_TILE_SIZE, gdk_pixbuf_get_height(image) - y));
+  g_assert_cmpint(gdk_pixbuf_get_n_channels(tile), ==, 3);
+
+  for (row = 0; row < height; row++)
+  {
+    g_assert(!memcmp(gdk_pixbuf_get_pixels(tile) +
+                     row * gdk_pixbuf_get_rowstride(tile),
+                     gdk_pixbuf_get_pixels(image) +
+                     (y + row) * gdk_pixbuf_get_rowstride(image) + x * 3,
+                     width * 3));
+  }
+}
+
+static void
+test_read_tiles(void)
+{
+  TestContainer c;
+  HildonTimeZoneTiledMap *map;
+  guint i;
+
+  _container_init(&c);
+  _write(&c, _pack(&c, G_MAXUINT));
+
+  map = hildon_time_zone_tiled_map_open(c.filename);
+  g_assert(map != NULL);
+  g_assert_cmpint(hildon_time_zone_tiled_map_get_tile_size(map), ==,
+                  TEST_TILE_SIZE);
+  g_assert_cmpint(hildon_time_zone_tiled_map_find_level(map, 70, 46), ==, -1);
+
+  for (i = 0; i < G_N_ELEMENTS(levels); i++)
+  {
+    gint level = hildon_time_zone_tiled_map_find_level(map, levels[i][0],
+                                                       levels[i][1]);
+    gint cols = (levels[i][0] + TEST_TILE_SIZE - 1) / TEST_TILE_SIZE;
+    gint rows = (levels[i][1] + TEST_TILE_SIZE - 1) / TEST_TILE_SIZE;
+    gint col;
+    gint row;
+
+    g_assert_cmpint(level, ==, i);
+
+    for (row = 0; row < rows; row++)
+    {
+      for (col = 0; col < cols; col++)
+      {
+        GdkPixbuf *tile =
+            hildon_time_zone_tiled_map_load_tile(map, level, col, row);
+
+        g_assert(tile != NULL);
+        _assert_tile(tile, c.images[i], col * TEST_TILE_SIZE,
+                     row * TEST_TILE_SIZE);
+        g_object_unref(tile);
+      }
+    }
+
+    g_assert(!hildon_time_zone_tiled_map_load_tile(map, level, cols, 0));
+    g_assert(!hildon_time_zone_tiled_map_load_tile(map, level, 0, rows));
+    g_assert(!hildon_time_zone_tiled_map_load_tile(map, level, -1, 0));
+  }
+
+  hildon_time_zone_tiled_map_unref(map);
+  _container_clear(&c);
+}
+
+static void
+test_missing_tile(void)
+{
+  TestContainer c;
+  HildonTimeZoneTiledMap *map;
+  GdkPixbuf *tile;
+
+  _container_init(&c);
+  _write(&c, _pack(&c, 1));
+
+  map = hildon_time_zone_tiled_map_open(c.filename);
+  g_assert(map != NULL);
+  g_assert(!hildon_time_zone_tiled_map_load_tile(map, 0, 1, 0));
+
+  tile = hildon_time_zone_tiled_map_load_tile(map, 0, 0, 0);
+  g_assert(tile != NULL);
+  g_object_unref(tile);
+
+  hildon_time_zone_tiled_map_unref(map);
+  _container_clear(&c);
+}
+
+/* A tile not matching its place in the level is not used */
+static void
+test_wrong_tile_size(void)
+{
+  TestContainer c;
+  HildonTimeZoneTiledMap *map;
+  GByteArray *data;
+  TiledMapTileEntry *tiles;
+
+  _container_init(&c);
+  data = _pack(&c, G_MAXUINT);
+  tiles = (TiledMapTileEntry *)(data->data + sizeof(TiledMapHeader) +
+                                G_N_ELEMENTS(levels) *
+                                sizeof(TiledMapLevelEntry));
+
+  /* the first tile pointing at the cut last one of the row */
+  tiles[0] = tiles[2];
+  _write(&c, data);
+
+  map = hildon_time_zone_tiled_map_open(c.filename);
+  g_assert(map != NULL);
+  g_assert(!hildon_time_zone_tiled_map_load_tile(map, 0, 0, 0));
+
+  hildon_time_zone_tiled_map_unref(map);
+  _container_clear(&c);
+}
+
+static void
+_assert_invalid(TestContainer *c, GByteArray *data)
+{
+  _write(c, data);
+  g_test_expect_message(NULL, G_LOG_LEVEL_WARNING, "Invalid tiled map *");
+  g_assert(!hildon_time_zone_tiled_map_open(c->filename));
+  g_test_assert_expected_messages();
+}
+
+static void
+test_invalid(void)
+{
+  TestContainer c;
+  GByteArray *data;
+  TiledMapHeader *header;
+  TiledMapTileEntry *tiles;
+  gsize table = sizeof(TiledMapHeader) +
+      G_N_ELEMENTS(levels) * sizeof(TiledMapLevelEntry);
+
+  _container_init(&c);
+
+  data = _pack(&c, G_MAXUINT);
+  data->data[0] = 'X';
+  _assert_invalid(&c, data);
+
+  data = _pack(&c, G_MAXUINT);
+  header = (TiledMapHeader *)data->data;
+  header->version = GUINT32_TO_LE(TILED_MAP_VERSION + 1);
+  _assert_invalid(&c, data);
+
+  data = _pack(&c, G_MAXUINT);
+  header = (TiledMapHeader *)data->data;
+  header->tile_size = 0;
+  _assert_invalid(&c, data);
+
+  data = _pack(&c, G_MAXUINT);
+  header = (TiledMapHeader *)data->data;
+  header->n_levels = GUINT32_TO_LE(TILED_MAP_MAX_LEVELS + 1);
+  _assert_invalid(&c, data);
+
+  /* the tile table cut short */
+  data = _pack(&c, G_MAXUINT);
+  g_byte_array_set_size(data, table + sizeof(TiledMapTileEntry));
+  _assert_invalid(&c, data);
+
+  /* tile data past the end of the file */
+  data = _pack(&c, G_MAXUINT);
+  tiles = (TiledMapTileEntry *)(data->data + table);
+  tiles[3].offset = GUINT64_TO_LE(data->len - 4);
+  _assert_invalid(&c, data);
+
+  data = _pack(&c, G_MAXUINT);
+  tiles = (TiledMapTileEntry *)(data->data + table);
+  tiles[3].offset = GUINT64_TO_LE(G_MAXUINT64);
+  _assert_invalid(&c, data);
+
+  _container_clear(&c);
+}
+
+int
+main(int argc, char **argv)
+{
+  g_test_init(&argc, &argv, NULL);
+
+  g_test_add_func("/tiled-map/read-tiles", test_read_tiles);
+  g_test_add_func("/tiled-map/missing-tile", test_missing_tile);
+  g_test_add_func("/tiled-map/wrong-tile-size", test_wrong_tile_size);
+  g_test_add_func("/tiled-map/invalid", test_invalid);
+
+  return g_test_run();
+}
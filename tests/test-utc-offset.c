@@ -0,0 +1,309 @@
+/* Checks how long UTC offsets are trusted, reading zone data written to a
+ * temporary TZDIR: well formed version 1 and 2 files, with and without a TZ
+ * string footer, as well as truncated ones and ones with bogus counts. The
+ * source is included for its static functions. */
+
+#include <stdlib.h>
+#include <glib/gstdio.h>
+
+#include "hildon-time-zone-utc-offset.c"
+
+/* Zone data goes here */
+static gchar *tzdir = NULL;
+
+static void
+_append_be32(GString *data, guint32 v)
+{
+  v = GUINT32_TO_BE(v);
+  g_string_append_len(data, (const gchar *)&v, sizeof(v));
+}
+
+static void
+_append_be64(GString *data, gint64 v)
+{
+  guint64 u = GUINT64_TO_BE((guint64)v);
+
+  g_string_append_len(data, (const gchar *)&u, sizeof(u));
+}
+
+/* Appends a TZif header of @version and its data block with the transition
+ * @times, of @time_size bytes each, to a single UTC type */
+static void
+_append_block(GString *data, gchar version, const gint64 *times,
+              guint32 timecnt, gsize time_size)
+{
+  guint32 i;
+
+  g_string_append(data, "TZif");
+  g_string_append_c(data, version);
+  g_string_append_len(data, "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0", 15);
+
+  /* isutcnt, isstdcnt, leapcnt, timecnt, typecnt and charcnt */
+  _append_be32(data, 0);
+  _append_be32(data, 0);
+  _append_be32(data, 0);
+  _append_be32(data, timecnt);
+  _append_be32(data, 1);
+  _append_be32(data, 4);
+
+  for (i = 0; i < timecnt; i++)
+  {
+    if (time_size == 8)
+      _append_be64(data, times[i]);
+    else
+      _append_be32(data, (guint32)times[i]);
+  }
+
+  for (i = 0; i < timecnt; i++)
+    g_string_append_c(data, 0);
+
+  /* utoff, isdst and desigidx */
+  _append_be32(data, 0);
+  g_string_append_len(data, "\0\0", 2);
+  g_string_append_len(data, "UTC", 4);
+}
+
+/* A version 2 file with the same @times in both blocks, then @footer unless
+ * NULL */
+static GString *
+_v2_data(const gint64 *times, guint32 timecnt, const gchar *footer)
+{
+  GString *data = g_string_new(NULL);
+
+  _append_block(data, '2', times, timecnt, 4);
+  _append_block(data, '2', times, timecnt, 8);
+
+  if (footer)
+    g_string_append(data, footer);
+
+  return data;
+}
+
+/* Writes the first @length bytes of @data as @zone */
+static void
+_write_zone(const gchar *zone, GString *data, gsize length)
+{
+  gchar *filename = g_build_filename(tzdir, zone, NULL);
+
+  g_assert(g_file_set_contents(filename, data->str, length, NULL));
+  g_free(filename);
+}
+
+static void
+_remove_zone(const gchar *zone)
+{
+  gchar *filename = g_build_filename(tzdir, zone, NULL);
+
+  g_remove(filename);
+  g_free(filename);
+}
+
+static void
+_assert_next_transition(const gchar *zone, time_t now, time_t expected,
+                        gboolean expected_fixed)
+{
+  gboolean fixed = !expected_fixed;
+
+  g_assert_cmpint(_next_transition(zone, now, &fixed), ==, expected);
+  g_assert_cmpint(fixed, ==, expected_fixed);
+}
+
+/* The offset of @zone is trusted until @expected */
+static void
+_assert_expires(const gchar *zone, time_t expected)
+{
+  hildon_time_zone_utc_offset_clear_cache();
+  g_assert(_lookup(zone)->expires == expected);
+}
+
+/* The offset of @zone is trusted until the next quarter hour */
+static void
+_assert_expires_soon(const gchar *zone)
+{
+  time_t before = time(NULL);
+  time_t expires;
+
+  hildon_time_zone_utc_offset_clear_cache();
+  expires = _lookup(zone)->expires;
+
+  g_assert_cmpint(expires % UTC_OFFSET_RECHECK, ==, 0);
+  g_assert_cmpint(expires, >, before);
+  g_assert_cmpint(expires, <=, time(NULL) + UTC_OFFSET_RECHECK);
+}
+
+static void
+test_version1(void)
+{
+  time_t now = time(NULL);
+  gint64 times[] = { now - 3600, now + 3600, now + 7200 };
+  GString *data = g_string_new(NULL);
+
+  _append_block(data, '\0', times, G_N_ELEMENTS(times), 4);
+  _write_zone("v1", data, data->len);
+  g_string_free(data, TRUE);
+
+  _assert_next_transition("v1", now, now + 3600, FALSE);
+  _assert_next_transition(":v1", now + 3600, now + 7200, FALSE);
+
+  /* no footer to rule out later transitions */
+  _assert_next_transition("v1", now + 7200, 0, FALSE);
+
+  _assert_expires("v1", now + 3600);
+
+  _remove_zone("v1");
+}
+
+static void
+test_version2(void)
+{
+  time_t now = time(NULL);
+  gint64 times[] = { now + 3600 };
+  GString *data = g_string_new(NULL);
+
+  /* only the 64-bit block lists the transition */
+  _append_block(data, '2', NULL, 0, 4);
+  _append_block(data, '2', times, G_N_ELEMENTS(times), 8);
+  g_string_append(data, "\nEET-2EEST,M3.5.0/3,M10.5.0/4\n");
+  _write_zone("v2", data, data->len);
+  g_string_free(data, TRUE);
+
+  _assert_next_transition("v2", now, now + 3600, FALSE);
+  _assert_expires("v2", now + 3600);
+
+  _remove_zone("v2");
+}
+
+static void
+test_no_footer(void)
+{
+  time_t now = time(NULL);
+  gint64 times[] = { now - 3600 };
+  GString *data = _v2_data(times, G_N_ELEMENTS(times), NULL);
+
+  _write_zone("no-footer", data, data->len);
+  g_string_free(data, TRUE);
+
+  _assert_next_transition("no-footer", now, 0, FALSE);
+  _assert_expires_soon("no-footer");
+
+  _remove_zone("no-footer");
+}
+
+static void
+test_fixed_footer(void)
+{
+  time_t now = time(NULL);
+  gint64 times[] = { now - 3600 };
+  GString *data = _v2_data(times, G_N_ELEMENTS(times), "\n<+03>-3\n");
+
+  _write_zone("fixed", data, data->len);
+  g_string_free(data, TRUE);
+
+  _assert_next_transition("fixed", now, 0, TRUE);
+  _assert_expires("fixed", HILDON_TIME_ZONE_UTC_OFFSET_NEVER);
+
+  _remove_zone("fixed");
+}
+
+static void
+test_dst_footer(void)
+{
+  time_t now = time(NULL);
+  gint64 times[] = { now - 3600 };
+  GString *data = _v2_data(times, G_N_ELEMENTS(times),
+                           "\nEET-2EEST,M3.5.0/3,M10.5.0/4\n");
+
+  _write_zone("dst", data, data->len);
+  g_string_free(data, TRUE);
+
+  _assert_next_transition("dst", now, 0, FALSE);
+  _assert_expires_soon("dst");
+
+  _remove_zone("dst");
+}
+
+/* However short the file, no transition is made up and the zone is never
+ * taken for fixed */
+static void
+test_truncated(void)
+{
+  time_t now = time(NULL);
+  gint64 times[] = { now - 3600 };
+  GString *data = _v2_data(times, G_N_ELEMENTS(times), "\n<+03>-3\n");
+  gsize length;
+
+  for (length = 0; length < data->len; length++)
+  {
+    _write_zone("truncated", data, length);
+    _assert_next_transition("truncated", now, 0, FALSE);
+  }
+
+  g_string_free(data, TRUE);
+  _remove_zone("truncated");
+}
+
+/* Counts far beyond the file, as large as they get, in either header. The
+ * only transition is past, so all there is to get wrong is the footer. */
+static void
+test_huge_counts(void)
+{
+  static const guint32 counts[] = { 0x40000000, 0x80000000, 0xffffffff };
+  time_t now = time(NULL);
+  gint64 times[] = { now - 3600 };
+  guint i;
+  guint j;
+
+  for (i = 0; i < G_N_ELEMENTS(counts); i++)
+  {
+    for (j = 0; j < 2 * 6; j++)
+    {
+      GString *data = g_string_new(NULL);
+      guint32 count = GUINT32_TO_BE(counts[i]);
+      gsize header = 0;
+
+      _append_block(data, '2', times, G_N_ELEMENTS(times), 4);
+
+      if (j >= 6)
+        header = data->len;
+
+      _append_block(data, '2', times, G_N_ELEMENTS(times), 8);
+      g_string_append(data, "\n<+03>-3\n");
+
+      memcpy(data->str + header + TZIF_COUNTS + 4 * (j % 6), &count,
+             sizeof(count));
+      _write_zone("huge", data, data->len);
+      g_string_free(data, TRUE);
+
+      _assert_next_transition("huge", now, 0, FALSE);
+    }
+  }
+
+  _remove_zone("huge");
+}
+
+int
+main(int argc, char **argv)
+{
+  gint result;
+
+  g_test_init(&argc, &argv, NULL);
+
+  tzdir = g_build_filename(g_get_tmp_dir(), "test-utc-offset-XXXXXX", NULL);
+  g_assert(mkdtemp(tzdir));
+  g_setenv("TZDIR", tzdir, TRUE);
+
+  g_test_add_func("/utc-offset/version1", test_version1);
+  g_test_add_func("/utc-offset/version2", test_version2);
+  g_test_add_func("/utc-offset/no-footer", test_no_footer);
+  g_test_add_func("/utc-offset/fixed-footer", test_fixed_footer);
+  g_test_add_func("/utc-offset/dst-footer", test_dst_footer);
+  g_test_add_func("/utc-offset/truncated", test_truncated);
+  g_test_add_func("/utc-offset/huge-counts", test_huge_counts);
+
+  result = g_test_run();
+
+  g_rmdir(tzdir);
+  g_free(tzdir);
+
+  return result;
+}
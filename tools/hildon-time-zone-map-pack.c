@@ -0,0 +1,173 @@
+/* Packs a world map image into a tiled map container, see
+ * hildon-time-zone-tiled-map.h for the layout.
+ *
+ *   hildon-time-zone-map-pack [OPTION...] SOURCE OUTPUT WIDTHxHEIGHT...
+ *
+ * Every WIDTHxHEIGHT level is scaled from SOURCE, which should be at least as
+ * large as the largest level. The map widget takes the levels of its scaled
+ * up zoom factors from the container, 3000x1838 and 6000x3676 for the
+ * 1500x919 map, and expects 256 pixel tiles. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#include "hildon-time-zone-tiled-map.h"
+
+#define PACK_MAX_LEVELS 16
+#define PACK_MAX_SIZE 65536
+
+static gint tile_size = 256;
+static gint quality = 90;
+
+static GOptionEntry entries[] =
+{
+  { "tile-size", 't', 0, G_OPTION_ARG_INT, &tile_size,
+    "Width and height of the tiles, 256 by default", "PIXELS" },
+  { "quality", 'q', 0, G_OPTION_ARG_INT, &quality,
+    "JPEG quality of the tiles, 90 by default", "0-100" },
+  { NULL }
+};
+
+/* Compresses the tiles of one level, row by row, into @tiles */
+static gboolean
+_encode_level(GdkPixbuf *level, GPtrArray *tiles, GError **error)
+{
+  gint width = gdk_pixbuf_get_width(level);
+  gint height = gdk_pixbuf_get_height(level);
+  gchar *q = g_strdup_printf("%d", quality);
+  gint x;
+  gint y;
+
+  for (y = 0; y < height; y += tile_size)
+  {
+    for (x = 0; x < width; x += tile_size)
+    {
+      GdkPixbuf *tile = gdk_pixbuf_new_subpixbuf(
+            level, x, y, MIN(tile_size, width - x), MIN(tile_size, height - y));
+      gchar *buffer;
+      gsize length;
+      gboolean ok;
+
+      ok = gdk_pixbuf_save_to_buffer(tile, &buffer, &length, "jpeg", error,
+                                     "quality", q, NULL);
+      g_object_unref(tile);
+
+      if (!ok)
+      {
+        g_free(q);
+        return FALSE;
+      }
+
+      g_ptr_array_add(tiles, g_bytes_new_take(buffer, length));
+    }
+  }
+
+  g_free(q);
+
+  return TRUE;
+}
+
+int
+main(int argc, char **argv)
+{
+  GOptionContext *context;
+  GError *error = NULL;
+  GdkPixbuf *source;
+  GPtrArray *tiles;
+  GByteArray *data;
+  gint sizes[PACK_MAX_LEVELS][2];
+  gint n_levels;
+  gint l;
+
+  context = g_option_context_new("SOURCE OUTPUT WIDTHxHEIGHT...");
+  g_option_context_set_summary(context,
+                               "Packs a world map into a tiled map container.");
+  g_option_context_add_main_entries(context, entries, NULL);
+
+  if (!g_option_context_parse(context, &argc, &argv, &error))
+  {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+
+  g_option_context_free(context);
+  n_levels = argc - 3;
+
+  if (n_levels < 1 || n_levels > PACK_MAX_LEVELS)
+  {
+    g_printerr("Give the source, the output and 1 to %d level sizes\n",
+               PACK_MAX_LEVELS);
+    return 1;
+  }
+
+  if (tile_size < 1 || tile_size > PACK_MAX_SIZE || quality < 0 ||
+      quality > 100)
+  {
+    g_printerr("Invalid tile size or quality\n");
+    return 1;
+  }
+
+  for (l = 0; l < n_levels; l++)
+  {
+    gchar x;
+
+    if (sscanf(argv[l + 3], "%d%c%d", &sizes[l][0], &x, &sizes[l][1]) != 3 ||
+        x != 'x' || sizes[l][0] < 1 || sizes[l][0] > PACK_MAX_SIZE ||
+        sizes[l][1] < 1 || sizes[l][1] > PACK_MAX_SIZE)
+    {
+      g_printerr("Invalid level size %s\n", argv[l + 3]);
+      return 1;
+    }
+  }
+
+  source = gdk_pixbuf_new_from_file(argv[1], &error);
+
+  if (!source)
+  {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+
+  tiles = g_ptr_array_new_with_free_func((GDestroyNotify)g_bytes_unref);
+
+  for (l = 0; l < n_levels; l++)
+  {
+    GdkPixbuf *level = gdk_pixbuf_scale_simple(source, sizes[l][0],
+                                               sizes[l][1], GDK_INTERP_HYPER);
+    gboolean ok;
+
+    if (!level)
+    {
+      g_printerr("Out of memory scaling to %s\n", argv[l + 3]);
+      return 1;
+    }
+
+    ok = _encode_level(level, tiles, &error);
+    g_object_unref(level);
+
+    if (!ok)
+    {
+      g_printerr("%s\n", error->message);
+      return 1;
+    }
+  }
+
+  g_object_unref(source);
+  data = hildon_time_zone_tiled_map_pack(tile_size, sizes[0], n_levels,
+                                         tiles);
+  g_ptr_array_free(tiles, TRUE);
+
+  if (!g_file_set_contents(argv[2], (const gchar *)data->data, data->len,
+                           &error))
+  {
+    g_printerr("%s\n", error->message);
+    return 1;
+  }
+
+  g_byte_array_free(data, TRUE);
+
+  return 0;
+}